@@ -0,0 +1,97 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define XNET_X86
+#endif
+
+#include "cpu.h"
+#include "utils.h"
+
+#ifdef XNET_X86
+static uint64_t ReadXcr0() {
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+}
+#endif
+
+static CpuFeatures DetectCpuFeatures() {
+    CpuFeatures features;
+    memset(&features, 0, sizeof(features));
+#ifdef XNET_X86
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return features;
+    features.sse41 = ecx & bit_SSE4_1;
+    features.popcnt = ecx & bit_POPCNT;
+    bool osxsave = ecx & bit_OSXSAVE;
+    bool fma = ecx & bit_FMA;
+    uint64_t xcr0 = osxsave ? ReadXcr0() : 0;
+    // xmm and ymm state, plus opmask and zmm state for avx512
+    bool os_avx = (xcr0 & 0x6) == 0x6;
+    bool os_avx512 = os_avx && (xcr0 & 0xe0) == 0xe0;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return features;
+    features.avx2 = os_avx && (ebx & bit_AVX2);
+    features.fma = os_avx && fma;
+    features.avx512f = os_avx512 && (ebx & bit_AVX512F);
+    features.avx512bw = os_avx512 && (ebx & bit_AVX512BW);
+    features.avx512vnni = os_avx512 && (ecx & (1 << 11));
+#endif
+    return features;
+}
+
+const CpuFeatures &GetCpuFeatures() {
+    static const CpuFeatures features = DetectCpuFeatures();
+    return features;
+}
+
+CpuLevel DetectCpuLevel() {
+    const CpuFeatures &features = GetCpuFeatures();
+    if (features.avx512f && features.avx512bw && features.avx2 && 
+        features.fma) {
+        return features.avx512vnni ? CPU_AVX512_VNNI : CPU_AVX512;
+    }
+    if (features.avx2 && features.fma) return CPU_AVX2;
+    if (features.sse41) return CPU_SSE41;
+    return CPU_GENERIC;
+}
+
+std::string CpuLevelToString(CpuLevel level) {
+    switch (level) {
+        case CPU_GENERIC: return "generic";
+        case CPU_SSE41: return "sse4.1";
+        case CPU_AVX2: return "avx2";
+        case CPU_AVX512: return "avx512";
+        case CPU_AVX512_VNNI: return "avx512vnni";
+        default: return "unknown";
+    }
+}
+
+static CpuLevel ReadCpuLevel() {
+    CpuLevel level = DetectCpuLevel();
+    const char *env = getenv("XNET_CPU_LEVEL");
+    if (env == nullptr || env[0] == '\0') return level;
+    for (int i = CPU_GENERIC; i <= CPU_AVX512_VNNI; i++) {
+        CpuLevel forced = static_cast<CpuLevel>(i);
+        if (CpuLevelToString(forced) != env) continue;
+        if (forced > level) {
+            LOG("XNET_CPU_LEVEL=%s is not supported by the cpu, use %s", 
+                env, CpuLevelToString(level).c_str());
+            return level;
+        }
+        return forced;
+    }
+    ERROR("unknown XNET_CPU_LEVEL=%s, expect generic|sse4.1|avx2|avx512|avx512vnni", env);
+    return level;
+}
+
+CpuLevel GetCpuLevel() {
+    static const CpuLevel level = ReadCpuLevel();
+    return level;
+}
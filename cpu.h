@@ -0,0 +1,41 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: runtime cpu feature detection by cpuid
+ */
+
+#ifndef CPU_H_
+#define CPU_H_
+
+#include <string>
+
+// Instruction set levels kernels are built for, each level implies the
+// lower ones
+enum CpuLevel {
+    CPU_GENERIC = 0, // x86-64 baseline(sse2) or non x86
+    CPU_SSE41 = 1,
+    CPU_AVX2 = 2,    // avx2 + fma
+    CPU_AVX512 = 3,  // avx512f + avx512bw
+    CPU_AVX512_VNNI = 4, // + avx512vnni
+};
+
+struct CpuFeatures {
+    bool sse41;
+    bool popcnt;
+    bool avx2;
+    bool fma;
+    bool avx512f;
+    bool avx512bw;
+    bool avx512vnni;
+};
+
+// Features of the host, detected by cpuid once, avx/avx512 features are
+// only reported when the os saves the register state(xgetbv)
+const CpuFeatures &GetCpuFeatures();
+// Best level the host supports
+CpuLevel DetectCpuLevel();
+// Level used for kernel dispatch, it's DetectCpuLevel() unless env
+// XNET_CPU_LEVEL=generic|sse4.1|avx2|avx512|avx512vnni forces a lower one
+CpuLevel GetCpuLevel();
+std::string CpuLevelToString(CpuLevel level);
+
+#endif
@@ -0,0 +1,225 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: avx2 + fma kernels, built with -mavx2 -mfma
+ */
+
+#include <immintrin.h>
+#include <string.h>
+
+#include "kernels.h"
+#include "kernels-simd.h"
+
+struct Avx2 {
+    typedef __m256 Vec;
+    typedef __m256i IVec;
+    static const int kWidth = 8;
+    static Vec Load(const float *p) { return _mm256_loadu_ps(p); }
+    static void Store(float *p, Vec x) { _mm256_storeu_ps(p, x); }
+    static Vec Set1(float x) { return _mm256_set1_ps(x); }
+    static Vec Zero() { return _mm256_setzero_ps(); }
+    static Vec Add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+    static Vec Sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+    static Vec Mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+    static Vec Div(Vec a, Vec b) { return _mm256_div_ps(a, b); }
+    static Vec Min(Vec a, Vec b) { return _mm256_min_ps(a, b); }
+    static Vec Max(Vec a, Vec b) { return _mm256_max_ps(a, b); }
+    static Vec MulAdd(Vec a, Vec b, Vec c) { return _mm256_fmadd_ps(a, b, c); }
+    static Vec Floor(Vec x) { return _mm256_floor_ps(x); }
+    // 2^n, n is integral
+    static Vec Pow2(Vec n) {
+        IVec e = _mm256_add_epi32(_mm256_cvtps_epi32(n),
+                                  _mm256_set1_epi32(127));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(e, 23));
+    }
+    static float ReduceAdd(Vec x) {
+        __m128 y = _mm_add_ps(_mm256_castps256_ps128(x),
+                              _mm256_extractf128_ps(x, 1));
+        y = _mm_add_ps(y, _mm_movehl_ps(y, y));
+        y = _mm_add_ss(y, _mm_shuffle_ps(y, y, 1));
+        return _mm_cvtss_f32(y);
+    }
+    static float ReduceMin(Vec x) {
+        __m128 y = _mm_min_ps(_mm256_castps256_ps128(x),
+                              _mm256_extractf128_ps(x, 1));
+        y = _mm_min_ps(y, _mm_movehl_ps(y, y));
+        y = _mm_min_ss(y, _mm_shuffle_ps(y, y, 1));
+        return _mm_cvtss_f32(y);
+    }
+    static float ReduceMax(Vec x) {
+        __m128 y = _mm_max_ps(_mm256_castps256_ps128(x),
+                              _mm256_extractf128_ps(x, 1));
+        y = _mm_max_ps(y, _mm_movehl_ps(y, y));
+        y = _mm_max_ss(y, _mm_shuffle_ps(y, y, 1));
+        return _mm_cvtss_f32(y);
+    }
+    static IVec LoadInt(const int32_t *p) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    }
+    static IVec Set1Int(int32_t x) { return _mm256_set1_epi32(x); }
+    static IVec SubInt(IVec a, IVec b) { return _mm256_sub_epi32(a, b); }
+    static Vec IntToFloat(IVec x) { return _mm256_cvtepi32_ps(x); }
+    static IVec FloatToInt(Vec x) { return _mm256_cvtps_epi32(x); }
+    // Up to 16 entries are kept in 2 registers and looked up by permutes,
+    // bit 3 of the index selects the register, others are gathered
+    struct Lut {
+        __m256 low, high;
+        int size;
+        const float *codebook;
+    };
+    static Lut MakeLut(const float *codebook, int size) {
+        Lut lut = { _mm256_loadu_ps(codebook), _mm256_loadu_ps(codebook + 8),
+                    size, codebook };
+        return lut;
+    }
+    static Vec Lookup(const uint8_t *index, const Lut &lut) {
+        IVec i = _mm256_cvtepu8_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i *>(index)));
+        if (lut.size <= 8) return _mm256_permutevar8x32_ps(lut.low, i);
+        if (lut.size <= 16) {
+            return _mm256_blendv_ps(_mm256_permutevar8x32_ps(lut.low, i),
+                _mm256_permutevar8x32_ps(lut.high, i),
+                _mm256_castsi256_ps(_mm256_slli_epi32(i, 28)));
+        }
+        return _mm256_i32gather_ps(lut.codebook, i, 4);
+    }
+    // int16
+    static IVec LoadS16(const int16_t *p) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    }
+    static IVec MulAddPairs(IVec a, IVec b) { 
+        return _mm256_madd_epi16(a, b); 
+    }
+    static IVec AddInt(IVec a, IVec b) { return _mm256_add_epi32(a, b); }
+    // 2 vectors of int32 in int16 range to 16 int16, packs works in the
+    // 128 bit lanes, so the 64 bit groups are permuted back in order
+    static void StoreS16x2(int16_t *p, IVec a, IVec b) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), 
+            _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8));
+    }
+    // Bits, popcount of every byte of a & b by the nibble table
+    static IVec LoadBits(const uint64_t *p) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    }
+    static IVec AndPopCount8(IVec a, IVec b) {
+        const __m256i table = _mm256_setr_epi8(
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i mask = _mm256_set1_epi8(0x0f);
+        __m256i x = _mm256_and_si256(a, b);
+        return _mm256_add_epi8(
+            _mm256_shuffle_epi8(table, _mm256_and_si256(x, mask)),
+            _mm256_shuffle_epi8(table, 
+                _mm256_and_si256(_mm256_srli_epi16(x, 4), mask)));
+    }
+    static IVec AddBytes(IVec a, IVec b) { return _mm256_add_epi8(a, b); }
+    static int32_t ReduceBytes(IVec x) {
+        __m256i sum = _mm256_sad_epu8(x, _mm256_setzero_si256());
+        __m128i y = _mm_add_epi64(_mm256_castsi256_si128(sum), 
+                                  _mm256_extracti128_si256(sum, 1));
+        return _mm_cvtsi128_si32(y) + _mm_extract_epi32(y, 2);
+    }
+    // 4 vectors of int32 in [0, 255] to 32 bytes, the packs work in the
+    // 128 bit lanes, so the 4 byte groups are permuted back in order
+    static void StoreU8x4(uint8_t *p, IVec a, IVec b, IVec c, IVec d) {
+        __m256i x = _mm256_packus_epi16(_mm256_packs_epi32(a, b), 
+                                        _mm256_packs_epi32(c, d));
+        x = _mm256_permutevar8x32_epi32(x, 
+                _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), x);
+    }
+};
+
+// 4 bytes of row a from p, zero padded at the end of the row
+static inline uint32_t LoadGroup(const uint8_t *a, int p, int k) {
+    uint32_t group = 0;
+    memcpy(&group, a + p, p + 4 <= k ? 4 : k - p);
+    return group;
+}
+
+// vpmaddubsw saturates the int16 sum of two uint8 x int8 products, which
+// is not exact for full range uint8 inputs, so the bytes are widened to 
+// int16 and multiplied by vpmaddwd. Every 32 bytes of the packed weight 
+// are 8 rows x 4 k, rows 0-3 in the low lane and rows 4-7 in the high lane.
+// R rows of a are done together, so every weight load is used R times.
+template <int R>
+static void U8GemmPackedRows(const uint8_t *a, int k, const PackedU8Weight &b,
+        int offset_a, int offset_b, int32_t *c, int ldc) {
+    int k_pad = (k + 3) / 4 * 4, num_groups = k_pad / 4;
+    int32_t bias[R];
+    for (int r = 0; r < R; r++) {
+        int32_t a_sum = 0;
+        for (int p = 0; p < k; p++) a_sum += a[r * k + p];
+        bias[r] = (128 - offset_b) * a_sum + k * offset_a * offset_b;
+    }
+    __m256i voffset_a = _mm256_set1_epi32(offset_a);
+    for (int block = 0; block * 16 < b.n; block++) {
+        const int8_t *w = b.data.data() + block * 16 * k_pad;
+        __m256i acc[R][4];
+        for (int r = 0; r < R; r++) {
+            for (int t = 0; t < 4; t++) acc[r][t] = _mm256_setzero_si256();
+        }
+        for (int g = 0; g < num_groups; g++) {
+            __m256i w0 = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i *>(w + g * 64));
+            __m256i w1 = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i *>(w + g * 64 + 32));
+            __m256i w00 = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(w0));
+            __m256i w01 = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(w0, 1));
+            __m256i w10 = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(w1));
+            __m256i w11 = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(w1, 1));
+            for (int r = 0; r < R; r++) {
+                __m256i x = _mm256_broadcastq_epi64(_mm_cvtepu8_epi16(
+                    _mm_cvtsi32_si128(LoadGroup(a + r * k, g * 4, k))));
+                acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_madd_epi16(w00, x));
+                acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_madd_epi16(w01, x));
+                acc[r][2] = _mm256_add_epi32(acc[r][2], _mm256_madd_epi16(w10, x));
+                acc[r][3] = _mm256_add_epi32(acc[r][3], _mm256_madd_epi16(w11, x));
+            }
+        }
+        int valid = b.n - block * 16 < 16 ? b.n - block * 16 : 16;
+        const int32_t *row_sum = b.row_sum.data() + block * 16;
+        for (int r = 0; r < R; r++) {
+            // [r0 r1 r4 r5 | r2 r3 r6 r7] -> [r0 ... r7]
+            __m256i lo = _mm256_permute4x64_epi64(
+                _mm256_hadd_epi32(acc[r][0], acc[r][1]), 0xd8);
+            __m256i hi = _mm256_permute4x64_epi64(
+                _mm256_hadd_epi32(acc[r][2], acc[r][3]), 0xd8);
+            __m256i vbias = _mm256_set1_epi32(bias[r]);
+            lo = _mm256_sub_epi32(_mm256_add_epi32(lo, vbias), 
+                _mm256_mullo_epi32(voffset_a, _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i *>(row_sum))));
+            hi = _mm256_sub_epi32(_mm256_add_epi32(hi, vbias), 
+                _mm256_mullo_epi32(voffset_a, _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i *>(row_sum + 8))));
+            int32_t *out = c + r * ldc + block * 16;
+            if (valid == 16) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), lo);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 8), hi);
+            } else {
+                int32_t buf[16];
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(buf), lo);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(buf + 8), hi);
+                memcpy(out, buf, valid * sizeof(int32_t));
+            }
+        }
+    }
+}
+
+static void U8GemmPacked(int m, const uint8_t *a, const PackedU8Weight &b,
+        int offset_a, int offset_b, int32_t *c) {
+    int i = 0;
+    for (; i + 2 <= m; i += 2) {
+        U8GemmPackedRows<2>(a + i * b.k, b.k, b, offset_a, offset_b,
+                            c + i * b.n, b.n);
+    }
+    for (; i < m; i++) {
+        U8GemmPackedRows<1>(a + i * b.k, b.k, b, offset_a, offset_b,
+                            c + i * b.n, b.n);
+    }
+}
+
+void RegisterAvx2Kernels(Kernels *kernels) {
+    kernels->level = CPU_AVX2;
+    RegisterSimdKernels<Avx2>(kernels);
+    kernels->u8_gemm_packed = U8GemmPacked;
+}
@@ -0,0 +1,104 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: avx512 kernels, built with -mavx512f -mavx512bw
+ */
+
+#include <immintrin.h>
+
+#include "kernels.h"
+#include "kernels-simd.h"
+
+struct Avx512 {
+    typedef __m512 Vec;
+    typedef __m512i IVec;
+    static const int kWidth = 16;
+    static Vec Load(const float *p) { return _mm512_loadu_ps(p); }
+    static void Store(float *p, Vec x) { _mm512_storeu_ps(p, x); }
+    static Vec Set1(float x) { return _mm512_set1_ps(x); }
+    static Vec Zero() { return _mm512_setzero_ps(); }
+    static Vec Add(Vec a, Vec b) { return _mm512_add_ps(a, b); }
+    static Vec Sub(Vec a, Vec b) { return _mm512_sub_ps(a, b); }
+    static Vec Mul(Vec a, Vec b) { return _mm512_mul_ps(a, b); }
+    static Vec Div(Vec a, Vec b) { return _mm512_div_ps(a, b); }
+    static Vec Min(Vec a, Vec b) { return _mm512_min_ps(a, b); }
+    static Vec Max(Vec a, Vec b) { return _mm512_max_ps(a, b); }
+    static Vec MulAdd(Vec a, Vec b, Vec c) { return _mm512_fmadd_ps(a, b, c); }
+    static Vec Floor(Vec x) {
+        return _mm512_roundscale_ps(x, _MM_FROUND_TO_NEG_INF);
+    }
+    // 2^n, n is integral
+    static Vec Pow2(Vec n) {
+        IVec e = _mm512_add_epi32(_mm512_cvtps_epi32(n),
+                                  _mm512_set1_epi32(127));
+        return _mm512_castsi512_ps(_mm512_slli_epi32(e, 23));
+    }
+    static float ReduceAdd(Vec x) { return _mm512_reduce_add_ps(x); }
+    static float ReduceMin(Vec x) { return _mm512_reduce_min_ps(x); }
+    static float ReduceMax(Vec x) { return _mm512_reduce_max_ps(x); }
+    static IVec LoadInt(const int32_t *p) { return _mm512_loadu_si512(p); }
+    static IVec Set1Int(int32_t x) { return _mm512_set1_epi32(x); }
+    static IVec SubInt(IVec a, IVec b) { return _mm512_sub_epi32(a, b); }
+    static Vec IntToFloat(IVec x) { return _mm512_cvtepi32_ps(x); }
+    static IVec FloatToInt(Vec x) { return _mm512_cvtps_epi32(x); }
+    // Up to 16 entries are kept in a register and looked up by a permute,
+    // others are gathered
+    struct Lut {
+        __m512 table;
+        int size;
+        const float *codebook;
+    };
+    static Lut MakeLut(const float *codebook, int size) {
+        Lut lut = { _mm512_loadu_ps(codebook), size, codebook };
+        return lut;
+    }
+    static Vec Lookup(const uint8_t *index, const Lut &lut) {
+        IVec i = _mm512_cvtepu8_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(index)));
+        if (lut.size <= 16) return _mm512_permutexvar_ps(i, lut.table);
+        return _mm512_i32gather_ps(i, lut.codebook, 4);
+    }
+    // int16
+    static IVec LoadS16(const int16_t *p) { return _mm512_loadu_si512(p); }
+    static IVec MulAddPairs(IVec a, IVec b) { 
+        return _mm512_madd_epi16(a, b); 
+    }
+    static IVec AddInt(IVec a, IVec b) { return _mm512_add_epi32(a, b); }
+    // 2 vectors of int32 in int16 range to 32 int16
+    static void StoreS16x2(int16_t *p, IVec a, IVec b) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), 
+                            _mm512_cvtsepi32_epi16(a));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p + 16), 
+                            _mm512_cvtsepi32_epi16(b));
+    }
+    // Bits, popcount of every byte of a & b by the nibble table,
+    // vpopcntq needs avx512vpopcntdq, which is not part of this level
+    static IVec LoadBits(const uint64_t *p) { return _mm512_loadu_si512(p); }
+    static IVec AndPopCount8(IVec a, IVec b) {
+        const __m512i table = _mm512_broadcast_i32x4(_mm_setr_epi8(
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+        const __m512i mask = _mm512_set1_epi8(0x0f);
+        __m512i x = _mm512_and_si512(a, b);
+        return _mm512_add_epi8(
+            _mm512_shuffle_epi8(table, _mm512_and_si512(x, mask)),
+            _mm512_shuffle_epi8(table, 
+                _mm512_and_si512(_mm512_srli_epi16(x, 4), mask)));
+    }
+    static IVec AddBytes(IVec a, IVec b) { return _mm512_add_epi8(a, b); }
+    static int32_t ReduceBytes(IVec x) {
+        return static_cast<int32_t>(_mm512_reduce_add_epi64(
+            _mm512_sad_epu8(x, _mm512_setzero_si512())));
+    }
+    // 4 vectors of int32 in [0, 255] to 64 bytes
+    static void StoreU8x4(uint8_t *p, IVec a, IVec b, IVec c, IVec d) {
+        _mm512_storeu_si512(p, _mm512_inserti64x4(
+            _mm512_castsi256_si512(_mm256_setr_m128i(
+                _mm512_cvtusepi32_epi8(a), _mm512_cvtusepi32_epi8(b))),
+            _mm256_setr_m128i(_mm512_cvtusepi32_epi8(c), 
+                              _mm512_cvtusepi32_epi8(d)), 1));
+    }
+};
+
+void RegisterAvx512Kernels(Kernels *kernels) {
+    kernels->level = CPU_AVX512;
+    RegisterSimdKernels<Avx512>(kernels);
+}
@@ -0,0 +1,71 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: avx512 vnni kernels, built with -mavx512f -mavx512bw -mavx512vnni
+ */
+
+#include <immintrin.h>
+#include <string.h>
+
+#include "kernels.h"
+
+// 4 bytes of row a from p, zero padded at the end of the row
+static inline uint32_t LoadGroup(const uint8_t *a, int p, int k) {
+    uint32_t group = 0;
+    memcpy(&group, a + p, p + 4 <= k ? 4 : k - p);
+    return group;
+}
+
+// One vpdpbusd multiplies a 4 byte group of a with the 16 rows x 4 k of a
+// packed weight block and accumulates them into 16 int32 without
+// saturation. R rows of a are done together to reuse the weight loads.
+template <int R>
+static void U8GemmPackedRows(const uint8_t *a, int k, const PackedU8Weight &b,
+        int offset_a, int offset_b, int32_t *c, int ldc) {
+    int k_pad = (k + 3) / 4 * 4, num_groups = k_pad / 4;
+    int32_t bias[R];
+    for (int r = 0; r < R; r++) {
+        int32_t a_sum = 0;
+        for (int p = 0; p < k; p++) a_sum += a[r * k + p];
+        bias[r] = (128 - offset_b) * a_sum + k * offset_a * offset_b;
+    }
+    __m512i voffset_a = _mm512_set1_epi32(offset_a);
+    for (int block = 0; block * 16 < b.n; block++) {
+        const int8_t *w = b.data.data() + block * 16 * k_pad;
+        __m512i acc[R];
+        for (int r = 0; r < R; r++) acc[r] = _mm512_setzero_si512();
+        for (int g = 0; g < num_groups; g++) {
+            __m512i vw = _mm512_loadu_si512(w + g * 64);
+            for (int r = 0; r < R; r++) {
+                __m512i x = _mm512_set1_epi32(LoadGroup(a + r * k, g * 4, k));
+                acc[r] = _mm512_dpbusd_epi32(acc[r], x, vw);
+            }
+        }
+        int valid = b.n - block * 16 < 16 ? b.n - block * 16 : 16;
+        __mmask16 mask = static_cast<__mmask16>((1u << valid) - 1);
+        __m512i correction = _mm512_mullo_epi32(voffset_a,
+            _mm512_loadu_si512(b.row_sum.data() + block * 16));
+        for (int r = 0; r < R; r++) {
+            __m512i out = _mm512_sub_epi32(_mm512_add_epi32(acc[r],
+                _mm512_set1_epi32(bias[r])), correction);
+            _mm512_mask_storeu_epi32(c + r * ldc + block * 16, mask, out);
+        }
+    }
+}
+
+static void U8GemmPacked(int m, const uint8_t *a, const PackedU8Weight &b,
+        int offset_a, int offset_b, int32_t *c) {
+    int i = 0;
+    for (; i + 4 <= m; i += 4) {
+        U8GemmPackedRows<4>(a + i * b.k, b.k, b, offset_a, offset_b,
+                            c + i * b.n, b.n);
+    }
+    for (; i < m; i++) {
+        U8GemmPackedRows<1>(a + i * b.k, b.k, b, offset_a, offset_b,
+                            c + i * b.n, b.n);
+    }
+}
+
+void RegisterAvx512VnniKernels(Kernels *kernels) {
+    kernels->level = CPU_AVX512_VNNI;
+    kernels->u8_gemm_packed = U8GemmPacked;
+}
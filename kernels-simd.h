@@ -0,0 +1,614 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: float vector kernels shared by the sse4.1/avx2/avx512 kernels,
+ *        V is the vector traits of the level(eg: Sse41 in kernels-sse41.cc),
+ *        only include it from the kernels-<level>.cc files, they are built
+ *        with the -m flags of the level
+ */
+
+#ifndef KERNELS_SIMD_H_
+#define KERNELS_SIMD_H_
+
+#include <math.h>
+#include <stdint.h>
+#include <xmmintrin.h>
+
+#include <algorithm>
+
+#include "kernels.h"
+
+// exp by the cephes polynomial, relative error ~1e-7 on [-88, 88]
+template <class V>
+inline typename V::Vec SimdExp(typename V::Vec x) {
+    typedef typename V::Vec Vec;
+    x = V::Min(V::Max(x, V::Set1(-88.3762626647949f)),
+               V::Set1(88.3762626647949f));
+    // exp(x) = 2^n * exp(r), n = round(x / ln2)
+    Vec n = V::Floor(V::MulAdd(x, V::Set1(1.44269504088896341f),
+                               V::Set1(0.5f)));
+    x = V::Sub(x, V::Mul(n, V::Set1(0.693359375f)));
+    x = V::Sub(x, V::Mul(n, V::Set1(-2.12194440e-4f)));
+    Vec y = V::Set1(1.9875691500e-4f);
+    y = V::MulAdd(y, x, V::Set1(1.3981999507e-3f));
+    y = V::MulAdd(y, x, V::Set1(8.3334519073e-3f));
+    y = V::MulAdd(y, x, V::Set1(4.1665795894e-2f));
+    y = V::MulAdd(y, x, V::Set1(1.6666665459e-1f));
+    y = V::MulAdd(y, x, V::Set1(5.0000001201e-1f));
+    y = V::MulAdd(y, V::Mul(x, x), V::Add(x, V::Set1(1.0f)));
+    return V::Mul(y, V::Pow2(n));
+}
+
+template <class V>
+void SimdRelu(const float *in, int n, float *out) {
+    typename V::Vec zero = V::Zero();
+    int i = 0;
+    for (; i + V::kWidth <= n; i += V::kWidth) {
+        V::Store(out + i, V::Max(V::Load(in + i), zero));
+    }
+    for (; i < n; i++) {
+        out[i] = in[i] > 0 ? in[i] : 0;
+    }
+}
+
+template <class V>
+void SimdSigmoid(const float *in, int n, float *out) {
+    typename V::Vec one = V::Set1(1.0f);
+    int i = 0;
+    for (; i + V::kWidth <= n; i += V::kWidth) {
+        typename V::Vec e = SimdExp<V>(V::Sub(V::Zero(), V::Load(in + i)));
+        V::Store(out + i, V::Div(one, V::Add(one, e)));
+    }
+    for (; i < n; i++) {
+        out[i] = 1.0f / (1.0f + expf(-in[i]));
+    }
+}
+
+// tanh(x) = 1 - 2 / (exp(2x) + 1)
+template <class V>
+void SimdTanh(const float *in, int n, float *out) {
+    typename V::Vec one = V::Set1(1.0f), two = V::Set1(2.0f);
+    int i = 0;
+    for (; i + V::kWidth <= n; i += V::kWidth) {
+        typename V::Vec e = SimdExp<V>(V::Mul(two, V::Load(in + i)));
+        V::Store(out + i, V::Sub(one, V::Div(two, V::Add(e, one))));
+    }
+    for (; i < n; i++) {
+        out[i] = tanhf(in[i]);
+    }
+}
+
+template <class V>
+void SimdAdd(const float *x, int n, float *y) {
+    int i = 0;
+    for (; i + V::kWidth <= n; i += V::kWidth) {
+        V::Store(y + i, V::Add(V::Load(y + i), V::Load(x + i)));
+    }
+    for (; i < n; i++) {
+        y[i] += x[i];
+    }
+}
+
+template <class V>
+void SimdAxpy(float a, const float *x, int n, float *y) {
+    typename V::Vec va = V::Set1(a);
+    int i = 0;
+    for (; i + V::kWidth <= n; i += V::kWidth) {
+        V::Store(y + i, V::MulAdd(va, V::Load(x + i), V::Load(y + i)));
+    }
+    for (; i < n; i++) {
+        y[i] += a * x[i];
+    }
+}
+
+// 4 min and max chains, one chain is bound by the latency of min/max
+template <class V>
+void SimdMinMax(const float *data, int n, float *min, float *max) {
+    typedef typename V::Vec Vec;
+    int i = 0;
+    float min_value = data[0], max_value = data[0];
+    if (n >= 4 * V::kWidth) {
+        Vec vmin[4], vmax[4];
+        #pragma GCC unroll 4
+        for (int u = 0; u < 4; u++) {
+            vmin[u] = vmax[u] = V::Load(data + u * V::kWidth);
+        }
+        for (i = 4 * V::kWidth; i + 4 * V::kWidth <= n; i += 4 * V::kWidth) {
+            #pragma GCC unroll 4
+            for (int u = 0; u < 4; u++) {
+                Vec x = V::Load(data + i + u * V::kWidth);
+                vmin[u] = V::Min(vmin[u], x);
+                vmax[u] = V::Max(vmax[u], x);
+            }
+        }
+        min_value = V::ReduceMin(V::Min(V::Min(vmin[0], vmin[1]), 
+                                        V::Min(vmin[2], vmin[3])));
+        max_value = V::ReduceMax(V::Max(V::Max(vmax[0], vmax[1]), 
+                                        V::Max(vmax[2], vmax[3])));
+    }
+    for (; i < n; i++) {
+        if (data[i] < min_value) min_value = data[i];
+        if (data[i] > max_value) max_value = data[i];
+    }
+    *min = min_value;
+    *max = max_value;
+}
+
+template <class V>
+void SimdDequantize(const int32_t *src, int n, float scale,
+        int32_t zero_point, float *dest) {
+    typename V::Vec vscale = V::Set1(scale);
+    typename V::IVec vzero_point = V::Set1Int(zero_point);
+    int i = 0;
+    for (; i + V::kWidth <= n; i += V::kWidth) {
+        typename V::IVec x = V::SubInt(V::LoadInt(src + i), vzero_point);
+        V::Store(dest + i, V::Mul(vscale, V::IntToFloat(x)));
+    }
+    for (; i < n; i++) {
+        dest[i] = scale * (src[i] - zero_point);
+    }
+}
+
+// Same as the generic one: scale, round half up by floor(x + 0.5) on the 
+// clamped value, so the int conversion is exact, then pack 4 vectors to 
+// bytes with saturation
+template <class V>
+void SimdQuantize(const float *src, int n, float scale, uint8_t zero_point,
+        uint8_t *dest) {
+    typedef typename V::Vec Vec;
+    float inv_scale = scale != 0 ? 1.0f / scale : 0;
+    Vec vinv_scale = V::Set1(inv_scale), vzero_point = V::Set1(zero_point),
+        vmin = V::Zero(), vmax = V::Set1(255.0f), half = V::Set1(0.5f);
+    int i = 0;
+    for (; i + 4 * V::kWidth <= n; i += 4 * V::kWidth) {
+        typename V::IVec q[4];
+        #pragma GCC unroll 4
+        for (int u = 0; u < 4; u++) {
+            // Not a fused multiply add(see the Makefile), it rounds once
+            // and a point close to .5 could round to another byte than
+            // the generic one
+            Vec x = V::Add(V::Mul(V::Load(src + i + u * V::kWidth), 
+                                  vinv_scale), vzero_point);
+            x = V::Min(V::Max(x, vmin), vmax);
+            q[u] = V::FloatToInt(V::Floor(V::Add(x, half)));
+        }
+        V::StoreU8x4(dest + i, q[0], q[1], q[2], q[3]);
+    }
+    for (; i < n; i++) {
+        float point = zero_point + src[i] * inv_scale;
+        float round_point = std::max(0.f, std::min(255.f, point));
+        dest[i] = static_cast<uint8_t>(floorf(round_point + 0.5f));
+    }
+}
+
+template <class V>
+void SimdDequantizeBias(const int32_t *src, int n, float scale, 
+        const float *bias, ActivationType act, float *dest) {
+    typedef typename V::Vec Vec;
+    Vec vscale = V::Set1(scale), zero = V::Zero();
+    bool relu = act == ACTIVATION_RELU;
+    int i = 0;
+    for (; i + V::kWidth <= n; i += V::kWidth) {
+        Vec x = V::IntToFloat(V::LoadInt(src + i));
+        Vec y = bias != nullptr ? V::MulAdd(vscale, x, V::Load(bias + i)) :
+                                  V::Mul(vscale, x);
+        V::Store(dest + i, relu ? V::Max(y, zero) : y);
+    }
+    for (; i < n; i++) {
+        float y = scale * src[i] + (bias != nullptr ? bias[i] : 0);
+        dest[i] = relu && y < 0 ? 0 : y;
+    }
+    // The row is still in cache
+    switch (act) {
+        case ACTIVATION_SIGMOID: SimdSigmoid<V>(dest, n, dest); break;
+        case ACTIVATION_TANH: SimdTanh<V>(dest, n, dest); break;
+        default: break;
+    }
+}
+
+// Dot products of one row of a with 4 rows of b at a time
+template <class V>
+void SimdSgemmNT(int m, int n, int k, const float *a, int lda,
+        const float *b, int ldb, float beta, float *c, int ldc) {
+    typedef typename V::Vec Vec;
+    int kk = k / V::kWidth * V::kWidth;
+    for (int i = 0; i < m; i++) {
+        const float *a_row = a + i * lda;
+        float *c_row = c + i * ldc;
+        int j = 0;
+        for (; j + 4 <= n; j += 4) {
+            const float *b0 = b + j * ldb, *b1 = b0 + ldb,
+                        *b2 = b1 + ldb, *b3 = b2 + ldb;
+            Vec acc0 = V::Zero(), acc1 = V::Zero(),
+                acc2 = V::Zero(), acc3 = V::Zero();
+            for (int p = 0; p < kk; p += V::kWidth) {
+                Vec x = V::Load(a_row + p);
+                acc0 = V::MulAdd(x, V::Load(b0 + p), acc0);
+                acc1 = V::MulAdd(x, V::Load(b1 + p), acc1);
+                acc2 = V::MulAdd(x, V::Load(b2 + p), acc2);
+                acc3 = V::MulAdd(x, V::Load(b3 + p), acc3);
+            }
+            float sum[4] = { V::ReduceAdd(acc0), V::ReduceAdd(acc1),
+                             V::ReduceAdd(acc2), V::ReduceAdd(acc3) };
+            for (int p = kk; p < k; p++) {
+                sum[0] += a_row[p] * b0[p];
+                sum[1] += a_row[p] * b1[p];
+                sum[2] += a_row[p] * b2[p];
+                sum[3] += a_row[p] * b3[p];
+            }
+            for (int t = 0; t < 4; t++) {
+                c_row[j + t] = sum[t] +
+                    (beta == 0 ? 0 : beta * c_row[j + t]);
+            }
+        }
+        for (; j < n; j++) {
+            const float *b_row = b + j * ldb;
+            Vec acc = V::Zero();
+            for (int p = 0; p < kk; p += V::kWidth) {
+                acc = V::MulAdd(V::Load(a_row + p), V::Load(b_row + p), acc);
+            }
+            float sum = V::ReduceAdd(acc);
+            for (int p = kk; p < k; p++) {
+                sum += a_row[p] * b_row[p];
+            }
+            c_row[j] = sum + (beta == 0 ? 0 : beta * c_row[j]);
+        }
+    }
+}
+
+// R rows of x against C rows of w at a time, U vectors of k per step, so
+// there are R * C * U independent accumulators to hide the fma latency,
+// the C weight streams are prefetched a few cache lines ahead.
+// The small loops must be unrolled to keep acc in registers.
+template <class V, int R, int C, int U>
+void SimdSgemvRows(int n, int k, const float *x, int ldx, const float *w,
+        const float *bias, float *y, int ldy) {
+    typedef typename V::Vec Vec;
+    const int step = V::kWidth * U, prefetch = 128;
+    int kk = k / step * step;
+    int j = 0;
+    for (; j + C <= n; j += C) {
+        const float *w_rows[C];
+        #pragma GCC unroll 4
+        for (int t = 0; t < C; t++) w_rows[t] = w + (j + t) * k;
+        Vec acc[R][C][U];
+        #pragma GCC unroll 4
+        for (int r = 0; r < R; r++) {
+            #pragma GCC unroll 4
+            for (int t = 0; t < C; t++) {
+                #pragma GCC unroll 4
+                for (int u = 0; u < U; u++) acc[r][t][u] = V::Zero();
+            }
+        }
+        for (int p = 0; p < kk; p += step) {
+            Vec xv[R][U];
+            #pragma GCC unroll 4
+            for (int r = 0; r < R; r++) {
+                #pragma GCC unroll 4
+                for (int u = 0; u < U; u++) {
+                    xv[r][u] = V::Load(x + r * ldx + p + u * V::kWidth);
+                }
+            }
+            #pragma GCC unroll 4
+            for (int t = 0; t < C; t++) {
+                _mm_prefetch(reinterpret_cast<const char *>(
+                    w_rows[t] + p + prefetch), _MM_HINT_T0);
+                #pragma GCC unroll 4
+                for (int u = 0; u < U; u++) {
+                    Vec wv = V::Load(w_rows[t] + p + u * V::kWidth);
+                    #pragma GCC unroll 4
+                    for (int r = 0; r < R; r++) {
+                        acc[r][t][u] = V::MulAdd(xv[r][u], wv, acc[r][t][u]);
+                    }
+                }
+            }
+        }
+        #pragma GCC unroll 4
+        for (int r = 0; r < R; r++) {
+            const float *x_row = x + r * ldx;
+            #pragma GCC unroll 4
+            for (int t = 0; t < C; t++) {
+                Vec sum_v = acc[r][t][0];
+                #pragma GCC unroll 4
+                for (int u = 1; u < U; u++) sum_v = V::Add(sum_v, acc[r][t][u]);
+                float sum = V::ReduceAdd(sum_v);
+                for (int p = kk; p < k; p++) sum += x_row[p] * w_rows[t][p];
+                y[r * ldy + j + t] = sum + (bias != nullptr ? bias[j + t] : 0);
+            }
+        }
+    }
+    for (; j < n; j++) {
+        const float *w_row = w + j * k;
+        #pragma GCC unroll 4
+        for (int r = 0; r < R; r++) {
+            const float *x_row = x + r * ldx;
+            float sum = 0;
+            for (int p = 0; p < k; p++) sum += x_row[p] * w_row[p];
+            y[r * ldy + j] = sum + (bias != nullptr ? bias[j] : 0);
+        }
+    }
+}
+
+// Up to 4 rows of x share one pass over the weight, the blocks are chosen
+// to keep the accumulators and the x vectors in 16 registers
+template <class V>
+void SimdSgemv(int m, int n, int k, const float *x, int ldx,
+        const float *w, const float *bias, ActivationType act,
+        float *y, int ldy) {
+    for (int i = 0; i < m; i += 4) {
+        const float *x_rows = x + i * ldx;
+        float *y_rows = y + i * ldy;
+        switch (std::min(m - i, 4)) {
+            case 1: 
+                SimdSgemvRows<V, 1, 4, 2>(n, k, x_rows, ldx, w, bias, 
+                                          y_rows, ldy);
+                break;
+            case 2: 
+                SimdSgemvRows<V, 2, 4, 1>(n, k, x_rows, ldx, w, bias, 
+                                          y_rows, ldy);
+                break;
+            case 3: 
+                SimdSgemvRows<V, 3, 3, 1>(n, k, x_rows, ldx, w, bias, 
+                                          y_rows, ldy);
+                break;
+            default: 
+                SimdSgemvRows<V, 4, 2, 1>(n, k, x_rows, ldx, w, bias, 
+                                          y_rows, ldy);
+        }
+    }
+    // The output rows are still in cache
+    for (int i = 0; i < m; i++) {
+        float *y_row = y + i * ldy;
+        switch (act) {
+            case ACTIVATION_RELU: SimdRelu<V>(y_row, n, y_row); break;
+            case ACTIVATION_SIGMOID: SimdSigmoid<V>(y_row, n, y_row); break;
+            case ACTIVATION_TANH: SimdTanh<V>(y_row, n, y_row); break;
+            default: break;
+        }
+    }
+}
+
+template <class V>
+void SimdQuantizeS16(const float *src, int n, float scale, int16_t *dest) {
+    typedef typename V::Vec Vec;
+    float inv_scale = scale != 0 ? 1.0f / scale : 0;
+    Vec vinv_scale = V::Set1(inv_scale), vmin = V::Set1(-kS16Max), 
+        vmax = V::Set1(kS16Max), half = V::Set1(0.5f);
+    int i = 0;
+    for (; i + 2 * V::kWidth <= n; i += 2 * V::kWidth) {
+        typename V::IVec q[2];
+        #pragma GCC unroll 2
+        for (int u = 0; u < 2; u++) {
+            Vec x = V::Mul(V::Load(src + i + u * V::kWidth), vinv_scale);
+            x = V::Min(V::Max(x, vmin), vmax);
+            q[u] = V::FloatToInt(V::Floor(V::Add(x, half)));
+        }
+        V::StoreS16x2(dest + i, q[0], q[1]);
+    }
+    for (; i < n; i++) {
+        float point = std::max(static_cast<float>(-kS16Max), 
+            std::min(static_cast<float>(kS16Max), src[i] * inv_scale));
+        dest[i] = static_cast<int16_t>(floorf(point + 0.5f));
+    }
+}
+
+// R rows of a against one row of b at a time, a step is one pmaddwd of
+// 2 * kWidth int16, the int32 sums move to float every 4 steps before
+// they can overflow(see kS16Max)
+template <class V, int R>
+void SimdS16GemmRows(int n, int k, const int16_t *a, const int16_t *b,
+        float *c, int ldc) {
+    typedef typename V::Vec Vec;
+    typedef typename V::IVec IVec;
+    const int step = 2 * V::kWidth, max_steps = 4;
+    int kk = k / step * step;
+    for (int j = 0; j < n; j++) {
+        const int16_t *b_row = b + static_cast<int64_t>(j) * k;
+        Vec sum[R];
+        #pragma GCC unroll 4
+        for (int r = 0; r < R; r++) sum[r] = V::Zero();
+        for (int begin = 0; begin < kk; begin += max_steps * step) {
+            int end = std::min(kk, begin + max_steps * step);
+            IVec acc[R];
+            #pragma GCC unroll 4
+            for (int r = 0; r < R; r++) acc[r] = V::Set1Int(0);
+            for (int p = begin; p < end; p += step) {
+                IVec vb = V::LoadS16(b_row + p);
+                #pragma GCC unroll 4
+                for (int r = 0; r < R; r++) {
+                    acc[r] = V::AddInt(acc[r], 
+                        V::MulAddPairs(V::LoadS16(a + r * k + p), vb));
+                }
+            }
+            #pragma GCC unroll 4
+            for (int r = 0; r < R; r++) {
+                sum[r] = V::Add(sum[r], V::IntToFloat(acc[r]));
+            }
+        }
+        #pragma GCC unroll 4
+        for (int r = 0; r < R; r++) {
+            const int16_t *a_row = a + r * k;
+            int64_t tail = 0;
+            for (int p = kk; p < k; p++) {
+                tail += static_cast<int32_t>(a_row[p]) * b_row[p];
+            }
+            c[r * ldc + j] = V::ReduceAdd(sum[r]) + tail;
+        }
+    }
+}
+
+template <class V>
+void SimdS16Gemm(int m, int n, int k, const int16_t *a, const int16_t *b,
+        float *c, int ldc) {
+    for (int i = 0; i < m; i += 4) {
+        const int16_t *a_rows = a + i * k;
+        float *c_rows = c + i * ldc;
+        switch (std::min(m - i, 4)) {
+            case 1: SimdS16GemmRows<V, 1>(n, k, a_rows, b, c_rows, ldc); break;
+            case 2: SimdS16GemmRows<V, 2>(n, k, a_rows, b, c_rows, ldc); break;
+            case 3: SimdS16GemmRows<V, 3>(n, k, a_rows, b, c_rows, ldc); break;
+            default: SimdS16GemmRows<V, 4>(n, k, a_rows, b, c_rows, ldc);
+        }
+    }
+}
+
+// R rows of x against one row of the palette weight at a time, every
+// weight vector is looked up once for the R rows, 2 vectors of k per step
+template <class V, int R>
+void SimdPaletteGemvRows(int n, int k, const float *x, int ldx,
+        const uint8_t *index, const typename V::Lut &lut,
+        const float *codebook, const float *bias, float *y, int ldy) {
+    typedef typename V::Vec Vec;
+    const int step = 2 * V::kWidth;
+    int kk = k / step * step;
+    for (int j = 0; j < n; j++) {
+        const uint8_t *index_row = index + static_cast<int64_t>(j) * k;
+        Vec acc[R][2];
+        #pragma GCC unroll 4
+        for (int r = 0; r < R; r++) acc[r][0] = acc[r][1] = V::Zero();
+        for (int p = 0; p < kk; p += step) {
+            Vec w0 = V::Lookup(index_row + p, lut),
+                w1 = V::Lookup(index_row + p + V::kWidth, lut);
+            #pragma GCC unroll 4
+            for (int r = 0; r < R; r++) {
+                const float *x_row = x + r * ldx + p;
+                acc[r][0] = V::MulAdd(V::Load(x_row), w0, acc[r][0]);
+                acc[r][1] = V::MulAdd(V::Load(x_row + V::kWidth), w1,
+                                      acc[r][1]);
+            }
+        }
+        #pragma GCC unroll 4
+        for (int r = 0; r < R; r++) {
+            const float *x_row = x + r * ldx;
+            float sum = V::ReduceAdd(V::Add(acc[r][0], acc[r][1]));
+            for (int p = kk; p < k; p++) {
+                sum += x_row[p] * codebook[index_row[p]];
+            }
+            y[r * ldy + j] = sum + (bias != nullptr ? bias[j] : 0);
+        }
+    }
+}
+
+template <class V>
+void SimdPaletteGemv(int m, int n, int k, const float *x, int ldx,
+        const uint8_t *index, const float *codebook, int codebook_size,
+        const float *bias, ActivationType act, float *y, int ldy) {
+    typename V::Lut lut = V::MakeLut(codebook, codebook_size);
+    for (int i = 0; i < m; i += 4) {
+        const float *x_rows = x + i * ldx;
+        float *y_rows = y + i * ldy;
+        switch (std::min(m - i, 4)) {
+            case 1:
+                SimdPaletteGemvRows<V, 1>(n, k, x_rows, ldx, index, lut,
+                                          codebook, bias, y_rows, ldy);
+                break;
+            case 2:
+                SimdPaletteGemvRows<V, 2>(n, k, x_rows, ldx, index, lut,
+                                          codebook, bias, y_rows, ldy);
+                break;
+            case 3:
+                SimdPaletteGemvRows<V, 3>(n, k, x_rows, ldx, index, lut,
+                                          codebook, bias, y_rows, ldy);
+                break;
+            default:
+                SimdPaletteGemvRows<V, 4>(n, k, x_rows, ldx, index, lut,
+                                          codebook, bias, y_rows, ldy);
+        }
+    }
+    for (int i = 0; i < m; i++) {
+        float *y_row = y + i * ldy;
+        switch (act) {
+            case ACTIVATION_RELU: SimdRelu<V>(y_row, n, y_row); break;
+            case ACTIVATION_SIGMOID: SimdSigmoid<V>(y_row, n, y_row); break;
+            case ACTIVATION_TANH: SimdTanh<V>(y_row, n, y_row); break;
+            default: break;
+        }
+    }
+}
+
+// R bit rows of x against one row of w at a time, the byte counts are
+// summed in registers for up to 31 vectors(at most 8 per byte each)
+template <class V, int R>
+void SimdAndPopCountRows(int n, int words, const uint64_t *x, int ldx, 
+        const uint64_t *w, int32_t *c, int ldc) {
+    typedef typename V::IVec IVec;
+    const int step = sizeof(IVec) / sizeof(uint64_t), max_steps = 31;
+    int full = words / step * step;
+    for (int j = 0; j < n; j++) {
+        const uint64_t *w_row = w + static_cast<int64_t>(j) * words;
+        int32_t count[R];
+        #pragma GCC unroll 4
+        for (int r = 0; r < R; r++) count[r] = 0;
+        for (int begin = 0; begin < full; begin += max_steps * step) {
+            int end = std::min(full, begin + max_steps * step);
+            IVec acc[R];
+            #pragma GCC unroll 4
+            for (int r = 0; r < R; r++) acc[r] = V::Set1Int(0);
+            for (int p = begin; p < end; p += step) {
+                IVec wv = V::LoadBits(w_row + p);
+                #pragma GCC unroll 4
+                for (int r = 0; r < R; r++) {
+                    acc[r] = V::AddBytes(acc[r], 
+                        V::AndPopCount8(V::LoadBits(x + r * ldx + p), wv));
+                }
+            }
+            #pragma GCC unroll 4
+            for (int r = 0; r < R; r++) count[r] += V::ReduceBytes(acc[r]);
+        }
+        #pragma GCC unroll 4
+        for (int r = 0; r < R; r++) {
+            const uint64_t *x_row = x + r * ldx;
+            for (int p = full; p < words; p++) {
+                count[r] += __builtin_popcountll(x_row[p] & w_row[p]);
+            }
+            c[r * ldc + j] = count[r];
+        }
+    }
+}
+
+template <class V>
+void SimdAndPopCount(int m, int n, int words, const uint64_t *x, int ldx, 
+        const uint64_t *w, int32_t *c, int ldc) {
+    for (int i = 0; i < m; i += 4) {
+        const uint64_t *x_rows = x + i * ldx;
+        int32_t *c_rows = c + i * ldc;
+        switch (std::min(m - i, 4)) {
+            case 1:
+                SimdAndPopCountRows<V, 1>(n, words, x_rows, ldx, w, c_rows, 
+                                          ldc);
+                break;
+            case 2:
+                SimdAndPopCountRows<V, 2>(n, words, x_rows, ldx, w, c_rows, 
+                                          ldc);
+                break;
+            case 3:
+                SimdAndPopCountRows<V, 3>(n, words, x_rows, ldx, w, c_rows, 
+                                          ldc);
+                break;
+            default:
+                SimdAndPopCountRows<V, 4>(n, words, x_rows, ldx, w, c_rows, 
+                                          ldc);
+        }
+    }
+}
+
+// Bind the float kernels of a level
+template <class V>
+void RegisterSimdKernels(Kernels *kernels) {
+    kernels->sgemm_nt = SimdSgemmNT<V>;
+    kernels->sgemv = SimdSgemv<V>;
+    kernels->palette_gemv = SimdPaletteGemv<V>;
+    kernels->and_popcount = SimdAndPopCount<V>;
+    kernels->relu = SimdRelu<V>;
+    kernels->sigmoid = SimdSigmoid<V>;
+    kernels->tanh = SimdTanh<V>;
+    kernels->add = SimdAdd<V>;
+    kernels->axpy = SimdAxpy<V>;
+    kernels->quantize_s16 = SimdQuantizeS16<V>;
+    kernels->s16_gemm = SimdS16Gemm<V>;
+    kernels->min_max = SimdMinMax<V>;
+    kernels->quantize = SimdQuantize<V>;
+    kernels->dequantize = SimdDequantize<V>;
+    kernels->dequantize_bias = SimdDequantizeBias<V>;
+}
+
+#endif
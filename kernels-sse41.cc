@@ -0,0 +1,135 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: sse4.1 kernels, built with -msse4.1
+ */
+
+#include <math.h>
+#include <smmintrin.h>
+
+#include "kernels.h"
+#include "kernels-simd.h"
+#include "third_party/gemmlowp/public/gemmlowp.h"
+
+struct Sse41 {
+    typedef __m128 Vec;
+    typedef __m128i IVec;
+    static const int kWidth = 4;
+    static Vec Load(const float *p) { return _mm_loadu_ps(p); }
+    static void Store(float *p, Vec x) { _mm_storeu_ps(p, x); }
+    static Vec Set1(float x) { return _mm_set1_ps(x); }
+    static Vec Zero() { return _mm_setzero_ps(); }
+    static Vec Add(Vec a, Vec b) { return _mm_add_ps(a, b); }
+    static Vec Sub(Vec a, Vec b) { return _mm_sub_ps(a, b); }
+    static Vec Mul(Vec a, Vec b) { return _mm_mul_ps(a, b); }
+    static Vec Div(Vec a, Vec b) { return _mm_div_ps(a, b); }
+    static Vec Min(Vec a, Vec b) { return _mm_min_ps(a, b); }
+    static Vec Max(Vec a, Vec b) { return _mm_max_ps(a, b); }
+    static Vec MulAdd(Vec a, Vec b, Vec c) {
+        return _mm_add_ps(_mm_mul_ps(a, b), c);
+    }
+    static Vec Floor(Vec x) { return _mm_floor_ps(x); }
+    // 2^n, n is integral
+    static Vec Pow2(Vec n) {
+        IVec e = _mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127));
+        return _mm_castsi128_ps(_mm_slli_epi32(e, 23));
+    }
+    static float ReduceAdd(Vec x) {
+        x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+        x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+        return _mm_cvtss_f32(x);
+    }
+    static float ReduceMin(Vec x) {
+        x = _mm_min_ps(x, _mm_movehl_ps(x, x));
+        x = _mm_min_ss(x, _mm_shuffle_ps(x, x, 1));
+        return _mm_cvtss_f32(x);
+    }
+    static float ReduceMax(Vec x) {
+        x = _mm_max_ps(x, _mm_movehl_ps(x, x));
+        x = _mm_max_ss(x, _mm_shuffle_ps(x, x, 1));
+        return _mm_cvtss_f32(x);
+    }
+    static IVec LoadInt(const int32_t *p) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    }
+    static IVec Set1Int(int32_t x) { return _mm_set1_epi32(x); }
+    static IVec SubInt(IVec a, IVec b) { return _mm_sub_epi32(a, b); }
+    static Vec IntToFloat(IVec x) { return _mm_cvtepi32_ps(x); }
+    static IVec FloatToInt(Vec x) { return _mm_cvtps_epi32(x); }
+    // No variable permute or gather, the codebook is read from memory
+    struct Lut {
+        const float *codebook;
+    };
+    static Lut MakeLut(const float *codebook, int size) {
+        Lut lut = { codebook };
+        return lut;
+    }
+    static Vec Lookup(const uint8_t *index, const Lut &lut) {
+        return _mm_setr_ps(lut.codebook[index[0]], lut.codebook[index[1]],
+                           lut.codebook[index[2]], lut.codebook[index[3]]);
+    }
+    // int16
+    static IVec LoadS16(const int16_t *p) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    }
+    static IVec MulAddPairs(IVec a, IVec b) { return _mm_madd_epi16(a, b); }
+    static IVec AddInt(IVec a, IVec b) { return _mm_add_epi32(a, b); }
+    // 2 vectors of int32 in int16 range to 8 int16
+    static void StoreS16x2(int16_t *p, IVec a, IVec b) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p), 
+                         _mm_packs_epi32(a, b));
+    }
+    // Bits, popcount of every byte of a & b by the nibble table
+    static IVec LoadBits(const uint64_t *p) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    }
+    static IVec AndPopCount8(IVec a, IVec b) {
+        const __m128i table = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 
+                                            1, 2, 2, 3, 2, 3, 3, 4);
+        const __m128i mask = _mm_set1_epi8(0x0f);
+        __m128i x = _mm_and_si128(a, b);
+        return _mm_add_epi8(
+            _mm_shuffle_epi8(table, _mm_and_si128(x, mask)),
+            _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(x, 4), mask)));
+    }
+    static IVec AddBytes(IVec a, IVec b) { return _mm_add_epi8(a, b); }
+    static int32_t ReduceBytes(IVec x) {
+        __m128i sum = _mm_sad_epu8(x, _mm_setzero_si128());
+        return _mm_cvtsi128_si32(sum) + _mm_extract_epi32(sum, 2);
+    }
+    // 4 vectors of int32 in [0, 255] to 16 bytes
+    static void StoreU8x4(uint8_t *p, IVec a, IVec b, IVec c, IVec d) {
+        __m128i x = _mm_packus_epi16(_mm_packs_epi32(a, b), 
+                                     _mm_packs_epi32(c, d));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p), x);
+    }
+};
+
+// gemmlowp needs sse4.1 on x86, so it is only built here
+static void GemmlowpU8Gemm(int m, int n, int k, const uint8_t *a,
+        const uint8_t *b, bool transpose_b, int offset_a, int offset_b,
+        int32_t *c, int num_threads) {
+    using namespace gemmlowp;
+    MatrixMap<const uint8_t, MapOrder::RowMajor> lhs(a, m, k, k);
+    MatrixMap<int32_t, MapOrder::RowMajor> result(c, m, n, n);
+    const std::tuple<> empty_pipeline = {};
+    // The context owns the worker threads, reuse it across calls
+    static thread_local GemmContext context;
+    context.set_max_num_threads(num_threads > 0 ? num_threads : 1);
+    if (transpose_b) {
+        MatrixMap<const uint8_t, MapOrder::ColMajor> rhs(b, k, n, k);
+        GemmWithOutputPipeline<uint8_t, int32_t, DefaultL8R8BitDepthParams>(
+            &context, lhs, rhs, &result, -offset_a, -offset_b,
+            empty_pipeline);
+    } else {
+        MatrixMap<const uint8_t, MapOrder::RowMajor> rhs(b, k, n, n);
+        GemmWithOutputPipeline<uint8_t, int32_t, DefaultL8R8BitDepthParams>(
+            &context, lhs, rhs, &result, -offset_a, -offset_b,
+            empty_pipeline);
+    }
+}
+
+void RegisterSse41Kernels(Kernels *kernels) {
+    kernels->level = CPU_SSE41;
+    RegisterSimdKernels<Sse41>(kernels);
+    kernels->u8_gemm = GemmlowpU8Gemm;
+}
@@ -0,0 +1,268 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: generic kernels and the registry, this file must build with the
+ *        baseline flags only
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "kernels.h"
+#include "utils.h"
+
+static void SgemmNT(int m, int n, int k, const float *a, int lda,
+        const float *b, int ldb, float beta, float *c, int ldc) {
+    for (int i = 0; i < m; i++) {
+        const float *a_row = a + i * lda;
+        for (int j = 0; j < n; j++) {
+            const float *b_row = b + j * ldb;
+            float sum = 0;
+            for (int p = 0; p < k; p++) {
+                sum += a_row[p] * b_row[p];
+            }
+            c[i * ldc + j] = sum + (beta == 0 ? 0 : beta * c[i * ldc + j]);
+        }
+    }
+}
+
+static void Relu(const float *in, int n, float *out) {
+    for (int i = 0; i < n; i++) {
+        out[i] = std::max(in[i], 0.0f);
+    }
+}
+
+static void Sigmoid(const float *in, int n, float *out) {
+    for (int i = 0; i < n; i++) {
+        out[i] = 1.0 / (1 + exp(-in[i]));
+    }
+}
+
+static void Tanh(const float *in, int n, float *out) {
+    for (int i = 0; i < n; i++) {
+        out[i] = tanh(in[i]);
+    }
+}
+
+static void Sgemv(int m, int n, int k, const float *x, int ldx,
+        const float *w, const float *bias, ActivationType act, 
+        float *y, int ldy) {
+    for (int i = 0; i < m; i++) {
+        const float *x_row = x + i * ldx;
+        float *y_row = y + i * ldy;
+        for (int j = 0; j < n; j++) {
+            const float *w_row = w + j * k;
+            float sum[4] = { 0, 0, 0, 0 };
+            int p = 0;
+            for (; p + 4 <= k; p += 4) {
+                sum[0] += x_row[p] * w_row[p];
+                sum[1] += x_row[p + 1] * w_row[p + 1];
+                sum[2] += x_row[p + 2] * w_row[p + 2];
+                sum[3] += x_row[p + 3] * w_row[p + 3];
+            }
+            for (; p < k; p++) sum[0] += x_row[p] * w_row[p];
+            y_row[j] = (sum[0] + sum[1]) + (sum[2] + sum[3]) + 
+                       (bias != nullptr ? bias[j] : 0);
+        }
+        switch (act) {
+            case ACTIVATION_RELU: Relu(y_row, n, y_row); break;
+            case ACTIVATION_SIGMOID: Sigmoid(y_row, n, y_row); break;
+            case ACTIVATION_TANH: Tanh(y_row, n, y_row); break;
+            default: break;
+        }
+    }
+}
+
+static void PaletteGemv(int m, int n, int k, const float *x, int ldx,
+        const uint8_t *index, const float *codebook, int codebook_size,
+        const float *bias, ActivationType act, float *y, int ldy) {
+    for (int i = 0; i < m; i++) {
+        const float *x_row = x + i * ldx;
+        float *y_row = y + i * ldy;
+        for (int j = 0; j < n; j++) {
+            const uint8_t *index_row = index + static_cast<int64_t>(j) * k;
+            float sum = 0;
+            for (int p = 0; p < k; p++) {
+                sum += x_row[p] * codebook[index_row[p]];
+            }
+            y_row[j] = sum + (bias != nullptr ? bias[j] : 0);
+        }
+        switch (act) {
+            case ACTIVATION_RELU: Relu(y_row, n, y_row); break;
+            case ACTIVATION_SIGMOID: Sigmoid(y_row, n, y_row); break;
+            case ACTIVATION_TANH: Tanh(y_row, n, y_row); break;
+            default: break;
+        }
+    }
+}
+
+static void AndPopCount(int m, int n, int words, const uint64_t *x, 
+        int ldx, const uint64_t *w, int32_t *c, int ldc) {
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            const uint64_t *x_row = x + i * ldx, *w_row = w + j * words;
+            int32_t count = 0;
+            for (int p = 0; p < words; p++) {
+                count += __builtin_popcountll(x_row[p] & w_row[p]);
+            }
+            c[i * ldc + j] = count;
+        }
+    }
+}
+
+static void Add(const float *x, int n, float *y) {
+    for (int i = 0; i < n; i++) {
+        y[i] += x[i];
+    }
+}
+
+static void Axpy(float a, const float *x, int n, float *y) {
+    for (int i = 0; i < n; i++) {
+        y[i] += a * x[i];
+    }
+}
+
+static void MinMax(const float *data, int n, float *min, float *max) {
+    *min = *max = data[0];
+    for (int i = 1; i < n; i++) {
+        if (data[i] > *max) *max = data[i];
+        if (data[i] < *min) *min = data[i];
+    }
+}
+
+static void Quantize(const float *src, int n, float scale,
+        uint8_t zero_point, uint8_t *dest) {
+    float inv_scale = scale != 0 ? 1.0f / scale : 0;
+    for (int i = 0; i < n; i++) {
+        float point = zero_point + src[i] * inv_scale;
+        float round_point = std::max(0.f, std::min(255.f, point));
+        dest[i] = static_cast<uint8_t>(floorf(round_point + 0.5f));
+    }
+}
+
+static void QuantizeS16(const float *src, int n, float scale, 
+        int16_t *dest) {
+    float inv_scale = scale != 0 ? 1.0f / scale : 0;
+    for (int i = 0; i < n; i++) {
+        float point = std::max(static_cast<float>(-kS16Max), 
+            std::min(static_cast<float>(kS16Max), src[i] * inv_scale));
+        dest[i] = static_cast<int16_t>(floorf(point + 0.5f));
+    }
+}
+
+static void S16Gemm(int m, int n, int k, const int16_t *a, 
+        const int16_t *b, float *c, int ldc) {
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            const int16_t *a_row = a + i * k, *b_row = b + j * k;
+            int64_t sum = 0;
+            for (int p = 0; p < k; p++) {
+                sum += static_cast<int32_t>(a_row[p]) * b_row[p];
+            }
+            c[i * ldc + j] = static_cast<float>(sum);
+        }
+    }
+}
+
+static void Dequantize(const int32_t *src, int n, float scale,
+        int32_t zero_point, float *dest) {
+    for (int i = 0; i < n; i++) {
+        dest[i] = scale * (src[i] - zero_point);
+    }
+}
+
+static void DequantizeBias(const int32_t *src, int n, float scale,
+        const float *bias, ActivationType act, float *dest) {
+    for (int i = 0; i < n; i++) {
+        dest[i] = scale * src[i] + (bias != nullptr ? bias[i] : 0);
+    }
+    switch (act) {
+        case ACTIVATION_RELU: Relu(dest, n, dest); break;
+        case ACTIVATION_SIGMOID: Sigmoid(dest, n, dest); break;
+        case ACTIVATION_TANH: Tanh(dest, n, dest); break;
+        default: break;
+    }
+}
+
+static void U8Gemm(int m, int n, int k, const uint8_t *a, const uint8_t *b,
+        bool transpose_b, int offset_a, int offset_b, int32_t *c,
+        int num_threads) {
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            int32_t sum = 0;
+            for (int p = 0; p < k; p++) {
+                int32_t b_value = transpose_b ? b[j * k + p] : b[p * n + j];
+                sum += (a[i * k + p] - offset_a) * (b_value - offset_b);
+            }
+            c[i * n + j] = sum;
+        }
+    }
+}
+
+void PackU8Weight(const uint8_t *w, int n, int k, PackedU8Weight *packed) {
+    int n_pad = (n + 15) / 16 * 16, k_pad = (k + 3) / 4 * 4;
+    packed->n = n;
+    packed->k = k;
+    packed->data.assign(n_pad * k_pad, 0);
+    packed->row_sum.assign(n_pad, 0);
+    for (int j = 0; j < n; j++) {
+        int8_t *block = packed->data.data() + (j / 16) * 16 * k_pad;
+        for (int p = 0; p < k; p++) {
+            // [k/4][16][4] inside the block of 16 rows
+            block[(p / 4) * 64 + (j % 16) * 4 + p % 4] = 
+                static_cast<int8_t>(w[j * k + p] - 128);
+            packed->row_sum[j] += w[j * k + p];
+        }
+    }
+}
+
+void RegisterGenericKernels(Kernels *kernels) {
+    kernels->level = CPU_GENERIC;
+    kernels->sgemm_nt = SgemmNT;
+    kernels->sgemv = Sgemv;
+    kernels->palette_gemv = PaletteGemv;
+    kernels->and_popcount = AndPopCount;
+    kernels->relu = Relu;
+    kernels->sigmoid = Sigmoid;
+    kernels->tanh = Tanh;
+    kernels->add = Add;
+    kernels->axpy = Axpy;
+    kernels->quantize_s16 = QuantizeS16;
+    kernels->s16_gemm = S16Gemm;
+    kernels->min_max = MinMax;
+    kernels->quantize = Quantize;
+    kernels->dequantize = Dequantize;
+    kernels->dequantize_bias = DequantizeBias;
+    kernels->u8_gemm = U8Gemm;
+    kernels->u8_gemm_packed = nullptr;
+}
+
+Kernels GetKernels(CpuLevel level) {
+    CHECK(level <= DetectCpuLevel());
+    Kernels kernels;
+    RegisterGenericKernels(&kernels);
+    if (level >= CPU_SSE41) RegisterSse41Kernels(&kernels);
+    if (level >= CPU_AVX2) RegisterAvx2Kernels(&kernels);
+    if (level >= CPU_AVX512) RegisterAvx512Kernels(&kernels);
+    if (level >= CPU_AVX512_VNNI) RegisterAvx512VnniKernels(&kernels);
+    return kernels;
+}
+
+const Kernels &GetKernels() {
+    static const Kernels kernels = GetKernels(GetCpuLevel());
+    return kernels;
+}
+
+void Activate(ActivationType act, const float *in, int n, float *out) {
+    const Kernels &kernels = GetKernels();
+    switch (act) {
+        case ACTIVATION_NONE: 
+            if (in != out) memcpy(out, in, n * sizeof(float));
+            break;
+        case ACTIVATION_RELU: kernels.relu(in, n, out); break;
+        case ACTIVATION_SIGMOID: kernels.sigmoid(in, n, out); break;
+        case ACTIVATION_TANH: kernels.tanh(in, n, out); break;
+        default: ERROR("unknown activation %d", act);
+    }
+}
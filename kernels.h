@@ -0,0 +1,122 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: kernel registry, the best kernels of the host cpu are bound at
+ *        startup, see cpu.h for the levels and the XNET_CPU_LEVEL override
+ */
+
+#ifndef KERNELS_H_
+#define KERNELS_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "cpu.h"
+
+// Weight(n x k, uint8) packed for the small batch int8 kernels. 
+// Rows are grouped by 16 and k by 4, the layout is [n/16][k/4][16][4] of 
+// int8 (w - 128), so one 4 byte group of the input is multiplied with 16 
+// rows by a single vpdpbusd. n and k are zero padded to 16 and 4.
+// The row sums of w are kept for the zero point correction.
+struct PackedU8Weight {
+    PackedU8Weight(): n(0), k(0) {}
+    int n, k;
+    std::vector<int8_t> data;
+    std::vector<int32_t> row_sum;
+};
+void PackU8Weight(const uint8_t *w, int n, int k, PackedU8Weight *packed);
+
+// Range of the int16 quantization, [-kS16Max, kS16Max]. Two products of
+// pmaddwd and 4 of its pair sums fit in int32 without overflow, so the
+// int16 kernels accumulate in int32 and move to float every 4 steps.
+const int kS16Max = 16383;
+
+enum ActivationType {
+    ACTIVATION_NONE = 0,
+    ACTIVATION_RELU = 1,
+    ACTIVATION_SIGMOID = 2,
+    ACTIVATION_TANH = 3,
+};
+
+struct Kernels {
+    CpuLevel level;
+    // c = a * b^T + beta * c, a: m x k, b: n x k, c: m x n, all row major
+    void (*sgemm_nt)(int m, int n, int k, const float *a, int lda, 
+                     const float *b, int ldb, float beta, float *c, int ldc);
+    // y = act(x * w^T + bias), x: m x k, w: n x k, y: m x n, row major, 
+    // bias can be nullptr. For small m(batch), w is streamed only once
+    void (*sgemv)(int m, int n, int k, const float *x, int ldx, 
+                  const float *w, const float *bias, ActivationType act, 
+                  float *y, int ldy);
+    // Activations, in and out can be the same buffer
+    void (*relu)(const float *in, int n, float *out);
+    void (*sigmoid)(const float *in, int n, float *out);
+    void (*tanh)(const float *in, int n, float *out);
+    // Same as sgemv, w[j][p] = codebook[index[j * k + p]], the codebook
+    // has 256 entries(zero padded after codebook_size) so any index is
+    // valid. The weight is looked up in registers, streamed once for up to
+    // 4 rows of x.
+    void (*palette_gemv)(int m, int n, int k, const float *x, int ldx, 
+                         const uint8_t *index, const float *codebook, 
+                         int codebook_size, const float *bias, 
+                         ActivationType act, float *y, int ldy);
+    // c[i][j] = popcount(x[i] & w[j]) of bit rows of words uint64, x: m
+    // rows of ldx words, w: n x words, c: m x n of ldc. The bits of the
+    // binary/ternary fully connect, popcount is by pshufb on simd levels.
+    void (*and_popcount)(int m, int n, int words, const uint64_t *x, 
+                         int ldx, const uint64_t *w, int32_t *c, int ldc);
+    // y += x
+    void (*add)(const float *x, int n, float *y);
+    // y += a * x
+    void (*axpy)(float a, const float *x, int n, float *y);
+    // Quantization
+    void (*min_max)(const float *data, int n, float *min, float *max);
+    // dest = zero_point + src / scale, rounded half up and saturated to
+    // [0, 255], scale 0 gives zero_point
+    void (*quantize)(const float *src, int n, float scale, 
+                     uint8_t zero_point, uint8_t *dest);
+    // dest = src / scale, rounded half up and saturated to
+    // [-kS16Max, kS16Max], scale 0 gives 0
+    void (*quantize_s16)(const float *src, int n, float scale, 
+                         int16_t *dest);
+    void (*dequantize)(const int32_t *src, int n, float scale, 
+                       int32_t zero_point, float *dest);
+    // dest = act(scale * src + bias), bias can be nullptr, the output 
+    // step of the int8 fully connect in one pass
+    void (*dequantize_bias)(const int32_t *src, int n, float scale, 
+                            const float *bias, ActivationType act, 
+                            float *dest);
+    // c = (a - offset_a) * (b - offset_b), b is k x n, or n x k when
+    // transpose_b, c is m x n, all row major
+    void (*u8_gemm)(int m, int n, int k, const uint8_t *a, const uint8_t *b,
+                    bool transpose_b, int offset_a, int offset_b, 
+                    int32_t *c, int num_threads);
+    // c = a * b^T, a: m x k, b: n x k of int16 in [-kS16Max, kS16Max],
+    // c: m x n of ldc, products are summed in int32 by pmaddwd on simd
+    // levels, the sums are exact up to float rounding
+    void (*s16_gemm)(int m, int n, int k, const int16_t *a, 
+                     const int16_t *b, float *c, int ldc);
+    // Same as u8_gemm with transpose_b on a packed b, for small m(batch), 
+    // nullptr if the level has no such kernel
+    void (*u8_gemm_packed)(int m, const uint8_t *a, const PackedU8Weight &b,
+                           int offset_a, int offset_b, int32_t *c);
+};
+
+// Apply act on n floats by the kernels of GetCpuLevel()
+void Activate(ActivationType act, const float *in, int n, float *out);
+
+// Kernels of GetCpuLevel(), bound on the first call
+const Kernels &GetKernels();
+// Kernels of a given level, the level must be supported by the cpu,
+// for tests and benchmarks of each path
+Kernels GetKernels(CpuLevel level);
+
+// Every level only overrides the kernels it speeds up, 
+// implemented in kernels-<level>.cc which is built with its own -m flags
+void RegisterGenericKernels(Kernels *kernels);
+void RegisterSse41Kernels(Kernels *kernels);
+void RegisterAvx2Kernels(Kernels *kernels);
+void RegisterAvx512Kernels(Kernels *kernels);
+void RegisterAvx512VnniKernels(Kernels *kernels);
+
+#endif
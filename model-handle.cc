@@ -0,0 +1,210 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+
+#include "model-handle.h"
+
+const int ModelHandle::kMaxThreads;
+
+struct ModelHandle::SlotPool {
+    SlotPool(): num_slots(0) {}
+    int Acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!free_slots.empty()) {
+            int slot = free_slots.back();
+            free_slots.pop_back();
+            return slot;
+        }
+        if (num_slots >= kMaxThreads) {
+            ERROR("more than %d threads use a ModelHandle", kMaxThreads);
+        }
+        return num_slots++;
+    }
+    void Release(int slot) {
+        std::lock_guard<std::mutex> lock(mutex);
+        free_slots.push_back(slot);
+    }
+    // Slots ever taken, the ones Load warms up
+    int NumSlots() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return num_slots;
+    }
+    std::mutex mutex;
+    std::vector<int> free_slots;
+    int num_slots;
+};
+
+struct ModelHandle::ThreadSlots {
+    struct Entry {
+        uint64_t handle_id;
+        std::weak_ptr<SlotPool> pool;
+        int slot;
+    };
+    ~ThreadSlots() {
+        for (int i = 0; i < entries.size(); i++) {
+            std::shared_ptr<SlotPool> pool = entries[i].pool.lock();
+            if (pool != nullptr) pool->Release(entries[i].slot);
+        }
+    }
+    std::vector<Entry> entries;
+};
+
+// Ids tell the handles apart, a new one may get the address of a 
+// destroyed one
+static std::atomic<uint64_t> next_handle_id(0);
+
+ModelHandle::ModelHandle(int input_dim, int max_warmup_batch):
+        id_(next_handle_id.fetch_add(1)), slot_pool_(new SlotPool()),
+        input_dim_(input_dim), max_warmup_batch_(max_warmup_batch),
+        cache_(nullptr), current_(nullptr), version_(0) {
+    // The replicas forward at the same time
+    SetBlasNumThreads(1);
+}
+
+ModelHandle::~ModelHandle() {
+    {
+        std::lock_guard<std::mutex> lock(load_thread_mutex_);
+        if (load_thread_.joinable()) load_thread_.join();
+    }
+    // No Forward may run on a handle being destroyed
+    delete current_.load();
+}
+
+int ModelHandle::ThreadSlot() {
+    static thread_local ThreadSlots thread_slots;
+    std::vector<ThreadSlots::Entry> &entries = thread_slots.entries;
+    for (int i = 0; i < entries.size(); i++) {
+        if (entries[i].handle_id == id_) return entries[i].slot;
+    }
+    // Drop the entries of the destroyed handles
+    for (int i = entries.size() - 1; i >= 0; i--) {
+        if (entries[i].pool.expired()) entries.erase(entries.begin() + i);
+    }
+    ThreadSlots::Entry entry;
+    entry.handle_id = id_;
+    entry.pool = slot_pool_;
+    entry.slot = slot_pool_->Acquire();
+    entries.push_back(entry);
+    return entry.slot;
+}
+
+void ModelHandle::WarmUp(XNet *net) const {
+    std::mt19937 generator(777);
+    std::uniform_real_distribution<float> distribution(-1.0, 1.0);
+    Matrix<float> in(max_warmup_batch_, input_dim_), out;
+    for (int i = 0; i < in.Size(); i++) {
+        in.Data()[i] = distribution(generator);
+    }
+    for (int batch = 1; batch <= max_warmup_batch_; batch *= 2) {
+        net->Forward(in.RowRange(0, batch), &out);
+    }
+}
+
+void ModelHandle::SetResultCache(ResultCache *cache) {
+    std::lock_guard<std::mutex> lock(load_mutex_);
+    if (current_.load() != nullptr) {
+        ERROR("SetResultCache must be called before the first Load");
+    }
+    cache_ = cache;
+}
+
+bool ModelHandle::Load(const std::string &proto_file,
+        const std::string &tune_file, std::string *error) {
+    std::lock_guard<std::mutex> lock(load_mutex_);
+    std::unique_ptr<Model> model(new Model());
+    // Nothing is swapped in until all the checks pass
+    auto fail = [&](const std::string &reason) {
+        LOG("model %s not loaded, %s, version %llu is kept", 
+            proto_file.c_str(), reason.c_str(), 
+            static_cast<unsigned long long>(version_.load()));
+        if (error != nullptr) *error = reason;
+        return false;
+    };
+    NetProto net_proto;
+    if (!XNet::ReadProto(proto_file, &net_proto)) {
+        return fail("the file is missing or not a valid net");
+    }
+    model->net.FromProto(net_proto);
+    std::string reason;
+    if (!model->net.CheckDims(input_dim_, &reason)) return fail(reason);
+    model->output_dim = model->net.OutputDim(input_dim_);
+    if (cache_ != nullptr && model->net.BatchDependent()) {
+        return fail("the net is batch dependent, it can not use the cache");
+    }
+    Model *current = current_.load();
+    if (current != nullptr && model->output_dim != current->output_dim) {
+        return fail("output dim " + std::to_string(model->output_dim) + 
+                    " is not " + std::to_string(current->output_dim));
+    }
+    if (tune_file != "") {
+        if (!std::ifstream(tune_file)) return fail("no tune file " + tune_file);
+        TuneTable table;
+        table.Read(tune_file);
+        if (table.Signature() != model->net.Signature()) {
+            return fail("the tune file is of another net");
+        }
+        // Other threads may be in blas now, see the constructor
+        model->net.SetTuneTable(table, false);
+    }
+    // Replicas for all the slots(nodes only, the weights are shared), 
+    // the ones of the slots taken so far are warmed up(buffers, lazy 
+    // weights, caches) so they do not build them on the request path
+    model->replicas.resize(kMaxThreads);
+    model->version = version_.load() + 1;
+    int warm_slots = std::max(1, slot_pool_->NumSlots());
+    for (int i = 0; i < kMaxThreads; i++) {
+        model->replicas[i].reset(new XNet());
+        model->net.Copy(model->replicas[i].get());
+        if (i < warm_slots) WarmUp(model->replicas[i].get());
+        // After the warm up, its random rows are not worth caching
+        model->replicas[i]->SetResultCache(cache_, model->version);
+    }
+
+    uint64_t version = model->version;
+    Model *old = current_.exchange(model.release());
+    version_.store(version);
+    LOG("model %s version %llu loaded", proto_file.c_str(),
+        static_cast<unsigned long long>(version));
+    if (old == nullptr) return true;
+    // Grace period, wait all the Forward calls on old to finish
+    for (int i = 0; i < kMaxThreads; i++) {
+        while (slots_[i].model.load() == old) {
+            std::this_thread::yield();
+        }
+    }
+    delete old;
+    // Free the entries of the old versions, no one hits them any more
+    if (cache_ != nullptr) cache_->Clear();
+    return true;
+}
+
+void ModelHandle::LoadAsync(const std::string &proto_file,
+        const std::string &tune_file) {
+    std::lock_guard<std::mutex> lock(load_thread_mutex_);
+    if (load_thread_.joinable()) load_thread_.join();
+    load_thread_ = std::thread([this, proto_file, tune_file]() {
+        Load(proto_file, tune_file);
+    });
+}
+
+void ModelHandle::Forward(const Matrix<float> &in, Matrix<float> *out) {
+    int id = ThreadSlot();
+    Slot &slot = slots_[id];
+    // Publish the version, then check it is still current, if Load swapped
+    // in between it may have missed the slot, so retry
+    Model *model = current_.load();
+    while (true) {
+        CHECK(model != nullptr);
+        slot.model.store(model);
+        Model *current = current_.load();
+        if (current == model) break;
+        model = current;
+    }
+    // Only the thread of the slot touches its replica after the swap
+    model->replicas[id]->Forward(in, out);
+    slot.model.store(nullptr);
+}
@@ -0,0 +1,100 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: a model which can be replaced under live traffic
+ */
+
+#ifndef MODEL_HANDLE_H_
+#define MODEL_HANDLE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "xnet.h"
+
+// Usage:
+//   ModelHandle model(784);
+//   model.Load("v1.net");
+//   ... model.Forward(in, &out) on any threads ...
+//   model.LoadAsync("v2.net"); // the traffic goes on
+//
+// Load builds and warms up the new version off the request path, then
+// swaps it in atomically. A Forward publishes the version it runs on in
+// the slot of its thread, the old version is freed after all the slots
+// moved off it(an RCU grace period), so in-flight Forward calls finish on
+// the old version, and there is no lock on the Forward path.
+//
+// Every version has one replica(XNet::Copy, weights shared) per slot,
+// since Forward keeps its buffers in the net. Load makes the replicas of
+// all the slots and warms up the ones in use, so Forward never builds
+// one. A thread takes a slot of the handle on its first Forward and gives
+// it back when it exits, at most kMaxThreads threads can use a handle at
+// the same time.
+class ModelHandle {
+public:
+    static const int kMaxThreads = 256;
+    // input_dim and max_warmup_batch are for the warm up, batch 1, 2, 4,
+    // ... up to max_warmup_batch runs on every replica before the swap
+    explicit ModelHandle(int input_dim, int max_warmup_batch = 32);
+    ~ModelHandle();
+    // Load, check, warm up and swap in, blocks until the old version is 
+    // freed, tune_file is optional, see xnet-tune. On a missing or 
+    // truncated file, a tune file of another net, or input/output dims 
+    // other than the ones of the current version, the current version is
+    // kept, and false is returned with the reason in error(if not nullptr)
+    bool Load(const std::string &proto_file,
+              const std::string &tune_file = "", std::string *error = nullptr);
+    // Load in a background thread, return at once unless the previous
+    // LoadAsync is still running, it waits for that one, a failure is 
+    // logged
+    void LoadAsync(const std::string &proto_file,
+                   const std::string &tune_file = "");
+    void Forward(const Matrix<float> &in, Matrix<float> *out);
+    // Use a result cache(not owned) on the replicas of every version, set
+    // it before the first Load. The entries are tagged by the version, so
+    // a new version never hits the outputs of an old one, and the cache is
+    // cleared after the old version is freed. A batch dependent version
+    // (see XNet::SetResultCache) is not loaded.
+    void SetResultCache(ResultCache *cache);
+    // 0 before the first Load, then 1, 2, ...
+    uint64_t Version() const { return version_.load(); }
+private:
+    struct Model {
+        uint64_t version;
+        int output_dim;
+        XNet net;
+        std::vector<std::unique_ptr<XNet> > replicas; // [slot]
+    };
+    // The version a thread is running on, nullptr when it is not in Forward,
+    // padded to a cache line so the slots do not share
+    struct Slot {
+        Slot(): model(nullptr) {}
+        std::atomic<Model *> model;
+        char padding[64 - sizeof(std::atomic<Model *>)];
+    };
+    // Free slots of the handle, shared with the threads which hold one, so
+    // a thread exiting after the handle is destroyed is fine
+    struct SlotPool;
+    // The slots a thread holds, of every handle it used
+    struct ThreadSlots;
+    int ThreadSlot();
+    void WarmUp(XNet *net) const;
+    uint64_t id_;
+    std::shared_ptr<SlotPool> slot_pool_;
+    int input_dim_, max_warmup_batch_;
+    ResultCache *cache_;
+    std::atomic<Model *> current_;
+    std::atomic<uint64_t> version_;
+    Slot slots_[kMaxThreads];
+    std::mutex load_mutex_; // one Load at a time
+    std::mutex load_thread_mutex_; // guards load_thread_
+    std::thread load_thread_;
+    DISALLOW_COPY_AND_ASSIGN(ModelHandle);
+};
+
+#endif
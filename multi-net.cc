@@ -0,0 +1,115 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ */
+
+#include <string.h>
+
+#include <map>
+#include <utility>
+
+#include "multi-net.h"
+
+// A first FullyConnect whose output can be sliced, no output head
+static bool CanFuse(const Node *node) {
+    if (node->Type() != NodeProto::FULLY_CONNECT) return false;
+    const OutputHead *head = node->GetOutputHead();
+    return head == nullptr || head->GetMode() == OutputHeadParameter::NONE;
+}
+
+MultiNet::MultiNet(const std::vector<const XNet *> &nets) {
+    CHECK(!nets.empty());
+    auto first_fc = [&nets](int i) {
+        return static_cast<const FullyConnect *>(nets[i]->GetNode(0));
+    };
+    // Group the nets by input dim and fused activation of the first layer
+    std::map<std::pair<int, int>, std::vector<int> > keys;
+    for (int i = 0; i < nets.size(); i++) {
+        CHECK(nets[i]->NumNodes() > 0);
+        const Node *first = nets[i]->GetNode(0);
+        if (!CanFuse(first)) continue;
+        const FullyConnect *fc = first_fc(i);
+        keys[std::make_pair(fc->Weight().NumCols(),
+                            static_cast<int>(fc->FusedActivation()))]
+            .push_back(i);
+    }
+    nets_.resize(nets.size());
+    for (int i = 0; i < nets.size(); i++) nets_[i].group = -1;
+    for (auto &it : keys) {
+        const std::vector<int> &members = it.second;
+        if (members.size() < 2) continue;
+        int rows = 0;
+        bool has_bias = false;
+        for (int m = 0; m < members.size(); m++) {
+            const FullyConnect *fc = first_fc(members[m]);
+            Net &net = nets_[members[m]];
+            net.group = groups_.size();
+            net.offset = rows;
+            net.dim = fc->Weight().NumRows();
+            rows += net.dim;
+            has_bias = has_bias || fc->Bias() != nullptr;
+        }
+        int cols = it.first.first;
+        Matrix<float> weight(rows, cols);
+        Vector<float> bias(rows);
+        for (int m = 0; m < members.size(); m++) {
+            const FullyConnect *fc = first_fc(members[m]);
+            const Net &net = nets_[members[m]];
+            const Matrix<float> &w = fc->Weight();
+            for (int j = 0; j < net.dim; j++) {
+                memcpy(weight.Data() + (net.offset + j) * weight.Stride(),
+                       w.Data() + j * w.Stride(), sizeof(float) * cols);
+                bias.Data()[net.offset + j] =
+                    fc->Bias() != nullptr ? fc->Bias()->Data()[j] : 0;
+            }
+        }
+        Group group;
+        group.node.reset(new FullyConnect());
+        group.node->SetWeight(std::move(weight));
+        if (has_bias) group.node->SetBias(std::move(bias));
+        group.node->FuseActivation(
+            static_cast<ActivationType>(it.first.second));
+        groups_.push_back(std::move(group));
+    }
+    for (int i = 0; i < nets.size(); i++) {
+        Net &net = nets_[i];
+        if (net.group < 0) {
+            net.rest.reset(new XNet());
+            nets[i]->Copy(net.rest.get());
+        } else if (nets[i]->NumNodes() > 1) {
+            net.rest.reset(new XNet());
+            nets[i]->Slice(1, nets[i]->NumNodes(), net.rest.get());
+        }
+    }
+}
+
+int MultiNet::NumFused() const {
+    int num_fused = 0;
+    for (int i = 0; i < nets_.size(); i++) {
+        if (nets_[i].group >= 0) num_fused++;
+    }
+    return num_fused;
+}
+
+void MultiNet::Forward(const Matrix<float> &in,
+        std::vector<Matrix<float> > *outs) {
+    CHECK(outs != nullptr);
+    outs->resize(nets_.size());
+    for (int g = 0; g < groups_.size(); g++) {
+        groups_[g].node->Forward(in, &groups_[g].out);
+    }
+    for (int i = 0; i < nets_.size(); i++) {
+        Net &net = nets_[i];
+        if (net.group < 0) {
+            net.rest->Forward(in, &(*outs)[i]);
+            continue;
+        }
+        Matrix<float> &group_out = groups_[net.group].out;
+        Matrix<float> view(group_out.Data() + net.offset,
+                           group_out.NumRows(), net.dim, group_out.Stride());
+        if (net.rest != nullptr) {
+            net.rest->Forward(view, &(*outs)[i]);
+        } else {
+            (*outs)[i] = view;
+        }
+    }
+}
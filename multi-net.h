@@ -0,0 +1,56 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: forward of several nets on the same input, the first fully
+ *        connect layers of the nets run as one wider one
+ */
+
+#ifndef MULTI_NET_H_
+#define MULTI_NET_H_
+
+#include <memory>
+#include <vector>
+
+#include "xnet.h"
+
+// Usage:
+//   MultiNet multi({ &net1, &net2, &net3 }); // eg: an ensemble or heads
+//   std::vector<Matrix<float> > outs;
+//   multi.Forward(in, &outs); // outs[i] is the output of net i
+//
+// Forwarding the nets one by one reads the input and streams a small
+// first layer weight once per net. The first FullyConnect nodes of the
+// nets with the same input dim and fused activation are concatenated
+// into one wide FullyConnect, which runs one gemm(gemv for small
+// batches) over the input for all of them, then the rest of every net
+// forwards on its columns of the wide output, a strided view without
+// copy. A net whose first node can not fuse(another node type, an
+// output head, or alone in its group) is forwarded on its own.
+//
+// Forward is not thread safe, like XNet::Forward.
+class MultiNet {
+public:
+    // The nodes are copied(weights shared), so are the tune tables of the
+    // rest of the nets
+    explicit MultiNet(const std::vector<const XNet *> &nets);
+    void Forward(const Matrix<float> &in, std::vector<Matrix<float> > *outs);
+    int NumNets() const { return nets_.size(); }
+    // Wide fully connect layers, and the nets whose first layers are in
+    // one of them
+    int NumGroups() const { return groups_.size(); }
+    int NumFused() const;
+private:
+    struct Group {
+        std::unique_ptr<FullyConnect> node;
+        Matrix<float> out;
+    };
+    struct Net {
+        int group; // -1 if not fused
+        int offset, dim; // columns of the net in the group output
+        std::unique_ptr<XNet> rest; // nullptr if the net is one layer
+    };
+    std::vector<Group> groups_;
+    std::vector<Net> nets_;
+    DISALLOW_COPY_AND_ASSIGN(MultiNet);
+};
+
+#endif
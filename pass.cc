@@ -0,0 +1,158 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ */
+
+#include "pass.h"
+
+// A FullyConnect whose output is linear, no fused activation or head
+static bool IsLinearFullyConnect(const Node *node) {
+    if (node->Type() != NodeProto::FULLY_CONNECT) return false;
+    const OutputHead *head = node->GetOutputHead();
+    return node->FusedActivation() == ACTIVATION_NONE &&
+           (head == nullptr || head->GetMode() == OutputHeadParameter::NONE);
+}
+
+static bool IsScale(const Node *node) {
+    return node->Type() == NodeProto::SCALE ||
+           node->Type() == NodeProto::BATCH_NORM;
+}
+
+static bool IsNoOp(const Node *node) {
+    if (node->Type() == NodeProto::IDENTITY) return true;
+    if (!IsScale(node)) return false;
+    const Scale *scale = static_cast<const Scale *>(node);
+    for (int i = 0; i < scale->Scales().Size(); i++) {
+        if (scale->Scales().Data()[i] != 1.0f) return false;
+        if (scale->Bias() != nullptr && scale->Bias()->Data()[i] != 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int DropIdentityPass::Run(std::vector<Node *> *nodes) const {
+    int num_no_ops = 0;
+    for (int i = 0; i < nodes->size(); i++) {
+        if (IsNoOp((*nodes)[i])) num_no_ops++;
+    }
+    // A net of no-op nodes keeps its first one
+    bool keep_first = num_no_ops == nodes->size();
+    std::vector<Node *> kept;
+    for (int i = 0; i < nodes->size(); i++) {
+        Node *node = (*nodes)[i];
+        if (IsNoOp(node) && !(keep_first && i == 0)) {
+            delete node;
+        } else {
+            kept.push_back(node);
+        }
+    }
+    int num_rewrites = nodes->size() - kept.size();
+    nodes->swap(kept);
+    return num_rewrites;
+}
+
+int FoldScalePass::Run(std::vector<Node *> *nodes) const {
+    std::vector<Node *> kept;
+    int num_rewrites = 0;
+    for (int i = 0; i < nodes->size(); i++) {
+        Node *node = (*nodes)[i];
+        if (!IsScale(node) || kept.empty() ||
+            !IsLinearFullyConnect(kept.back())) {
+            kept.push_back(node);
+            continue;
+        }
+        FullyConnect *fc = static_cast<FullyConnect *>(kept.back());
+        const Scale *scale = static_cast<const Scale *>(node);
+        const Matrix<float> &w = fc->Weight();
+        const Vector<float> *b = fc->Bias(), *t = scale->Bias();
+        const float *s = scale->Scales().Data();
+        CHECK(scale->Scales().Size() == w.NumRows());
+        Matrix<float> weight(w.NumRows(), w.NumCols());
+        Vector<float> bias(w.NumRows());
+        for (int j = 0; j < w.NumRows(); j++) {
+            const float *w_row = w.Data() + j * w.Stride();
+            float *weight_row = weight.Data() + j * weight.Stride();
+            for (int p = 0; p < w.NumCols(); p++) {
+                weight_row[p] = s[j] * w_row[p];
+            }
+            bias.Data()[j] = s[j] * (b != nullptr ? b->Data()[j] : 0) +
+                             (t != nullptr ? t->Data()[j] : 0);
+        }
+        fc->SetWeight(std::move(weight));
+        fc->SetBias(std::move(bias));
+        delete node;
+        num_rewrites++;
+    }
+    nodes->swap(kept);
+    return num_rewrites;
+}
+
+int MergeLinearPass::Run(std::vector<Node *> *nodes) const {
+    std::vector<Node *> kept;
+    int num_rewrites = 0;
+    for (int i = 0; i < nodes->size(); i++) {
+        Node *node = (*nodes)[i];
+        if (node->Type() != NodeProto::FULLY_CONNECT || kept.empty() ||
+            !IsLinearFullyConnect(kept.back())) {
+            kept.push_back(node);
+            continue;
+        }
+        // The second one keeps its name, activation and head
+        FullyConnect *first = static_cast<FullyConnect *>(kept.back()),
+                     *second = static_cast<FullyConnect *>(node);
+        const Matrix<float> &w1 = first->Weight(), &w2 = second->Weight();
+        int64_t k = w1.NumCols(), n1 = w1.NumRows(), n2 = w2.NumRows();
+        CHECK(w2.NumCols() == n1);
+        if (n2 * k > n1 * k + n2 * n1) {
+            kept.push_back(node);
+            continue;
+        }
+        Matrix<float> weight(n2, k);
+        weight.Mul(w2, w1);
+        const Vector<float> *b1 = first->Bias(), *b2 = second->Bias();
+        Vector<float> bias(n2);
+        for (int j = 0; j < n2; j++) {
+            double sum = b2 != nullptr ? b2->Data()[j] : 0;
+            if (b1 != nullptr) {
+                const float *w2_row = w2.Data() + j * w2.Stride();
+                for (int p = 0; p < n1; p++) sum += w2_row[p] * b1->Data()[p];
+            }
+            bias.Data()[j] = sum;
+        }
+        second->SetWeight(std::move(weight));
+        if (b1 != nullptr || b2 != nullptr) second->SetBias(std::move(bias));
+        delete first;
+        kept.back() = second;
+        num_rewrites++;
+    }
+    nodes->swap(kept);
+    return num_rewrites;
+}
+
+PassManager::~PassManager() {
+    for (int i = 0; i < passes_.size(); i++) delete passes_[i];
+}
+
+void PassManager::AddDefaultPasses() {
+    Add(new DropIdentityPass());
+    Add(new FoldScalePass());
+    Add(new MergeLinearPass());
+}
+
+int PassManager::Run(std::vector<Node *> *nodes) const {
+    const int max_rounds = 10;
+    int num_rewrites = 0;
+    for (int round = 0; round < max_rounds; round++) {
+        int round_rewrites = 0;
+        for (int i = 0; i < passes_.size(); i++) {
+            int n = passes_[i]->Run(nodes);
+            if (verbose_ && n > 0) {
+                LOG("pass %s: %d rewrites", passes_[i]->Name().c_str(), n);
+            }
+            round_rewrites += n;
+        }
+        num_rewrites += round_rewrites;
+        if (round_rewrites == 0) break;
+    }
+    return num_rewrites;
+}
@@ -0,0 +1,69 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: graph passes which rewrite the nodes of a net for inference,
+ *        XNet::FromProto runs the default ones
+ */
+
+#ifndef PASS_H_
+#define PASS_H_
+
+#include <string>
+#include <vector>
+
+#include "xnet.h"
+
+// A pass rewrites the node list in place, the nodes it drops are deleted
+// by it. Run returns the number of rewrites, 0 if nothing changed.
+class Pass {
+public:
+    virtual ~Pass() {}
+    virtual std::string Name() const = 0;
+    virtual int Run(std::vector<Node *> *nodes) const = 0;
+};
+
+// Drop the Identity nodes and the Scale nodes which are no-op(scale 1,
+// bias 0), at least one node is kept
+class DropIdentityPass: public Pass {
+public:
+    std::string Name() const { return "drop-identity"; }
+    int Run(std::vector<Node *> *nodes) const;
+};
+
+// Fold a Scale/BatchNorm into the FullyConnect before it,
+// W' = diag(scale) * W, b' = scale * b + bias
+class FoldScalePass: public Pass {
+public:
+    std::string Name() const { return "fold-scale"; }
+    int Run(std::vector<Node *> *nodes) const;
+};
+
+// Merge two FullyConnect nodes with no activation between them,
+// W = W2 * W1, b = W2 * b1 + b2, only when the merged one costs no more
+// flops than the two
+class MergeLinearPass: public Pass {
+public:
+    std::string Name() const { return "merge-linear"; }
+    int Run(std::vector<Node *> *nodes) const;
+};
+
+class PassManager {
+public:
+    PassManager(): verbose_(false) {}
+    ~PassManager();
+    // The pass is owned by the manager
+    void Add(Pass *pass) { passes_.push_back(pass); }
+    // drop-identity, fold-scale, merge-linear
+    void AddDefaultPasses();
+    // Log the rewrites of every pass
+    void SetVerbose(bool verbose) { verbose_ = verbose; }
+    // Run the passes in order, again until none of them rewrites, since
+    // one rewrite may enable another(eg: a dropped Identity between two
+    // fully connect nodes)
+    int Run(std::vector<Node *> *nodes) const;
+private:
+    std::vector<Pass *> passes_;
+    bool verbose_;
+    DISALLOW_COPY_AND_ASSIGN(PassManager);
+};
+
+#endif
@@ -0,0 +1,194 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "pipeline.h"
+
+// Wait of a spinning thread, spin first for the latency, then give the
+// core away when it stays idle
+class Backoff {
+public:
+    Backoff(): count_(0) {}
+    void Wait() {
+        count_++;
+        if (count_ < 64) return;
+        if (count_ < 1024) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+    void Reset() { count_ = 0; }
+private:
+    int count_;
+};
+
+PipelineNet::PipelineNet(const XNet &net, int num_stages, int queue_size, 
+        bool pin_threads): stop_(false) {
+    CHECK(net.NumNodes() > 0);
+    // The stages forward at the same time
+    SetBlasNumThreads(1);
+    CHECK(queue_size > 0);
+    stage_begin_ = num_stages > 0 ? PartitionByStages(net, num_stages) :
+                                    PartitionByBytes(net, L2CacheBytes());
+    int n = stage_begin_.size() - 1;
+    for (int i = 0; i < n; i++) {
+        stages_.push_back(std::unique_ptr<XNet>(new XNet()));
+        net.Slice(stage_begin_[i], stage_begin_[i + 1], stages_[i].get());
+    }
+    for (int i = 0; i <= n; i++) {
+        queues_.push_back(std::unique_ptr<Queue>(new Queue(queue_size)));
+    }
+    // No more micro-batches than the queues hold, so the caller never
+    // waits on a full first queue while the last one is full too
+    for (int i = 0; i < (n + 1) * queues_[0]->Capacity(); i++) {
+        pool_.push_back(std::unique_ptr<MicroBatch>(new MicroBatch()));
+    }
+    int num_cores = std::max(1U, std::thread::hardware_concurrency());
+    for (int i = 0; i < n; i++) {
+        threads_.push_back(std::thread(&PipelineNet::RunStage, this, i));
+        if (pin_threads) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % num_cores, &cpus);
+            pthread_setaffinity_np(threads_[i].native_handle(), 
+                                   sizeof(cpus), &cpus);
+        }
+    }
+}
+
+PipelineNet::~PipelineNet() {
+    stop_ = true;
+    for (int i = 0; i < threads_.size(); i++) threads_[i].join();
+}
+
+void PipelineNet::RunStage(int i) {
+    Queue *in = queues_[i].get(), *out = queues_[i + 1].get();
+    Backoff backoff;
+    MicroBatch *batch = nullptr;
+    while (!stop_.load(std::memory_order_relaxed)) {
+        if (!in->TryPop(&batch)) {
+            backoff.Wait();
+            continue;
+        }
+        backoff.Reset();
+        stages_[i]->Forward(batch->in, &batch->out);
+        std::swap(batch->in, batch->out);
+        while (!out->TryPush(batch)) {
+            if (stop_.load(std::memory_order_relaxed)) return;
+            backoff.Wait();
+        }
+        backoff.Reset();
+    }
+}
+
+void PipelineNet::Forward(const Matrix<float> &in, Matrix<float> *out, 
+        int micro_batch) {
+    CHECK(out != nullptr);
+    CHECK(micro_batch > 0);
+    int output_dim = in.NumCols();
+    for (int i = 0; i < stages_.size(); i++) {
+        output_dim = stages_[i]->OutputDim(output_dim);
+    }
+    out->Resize(in.NumRows(), output_dim);
+    int64_t num_batches = (in.NumRows() + micro_batch - 1) / micro_batch;
+    int64_t num_pushed = 0, num_done = 0;
+    std::vector<MicroBatch *> free;
+    for (int i = 0; i < pool_.size(); i++) free.push_back(pool_[i].get());
+    // Filled, waiting for room in the first queue
+    MicroBatch *pending = nullptr;
+    Backoff backoff;
+    while (num_done < num_batches) {
+        bool progress = false;
+        if (pending == nullptr && num_pushed < num_batches && 
+            !free.empty()) {
+            pending = free.back();
+            free.pop_back();
+            pending->row = num_pushed * micro_batch;
+            int rows = std::min<int64_t>(micro_batch, 
+                                         in.NumRows() - pending->row);
+            pending->in.Resize(rows, in.NumCols());
+            for (int r = 0; r < rows; r++) {
+                memcpy(pending->in.Data() + r * pending->in.Stride(), 
+                       in.Data() + (pending->row + r) * in.Stride(), 
+                       sizeof(float) * in.NumCols());
+            }
+        }
+        if (pending != nullptr && queues_[0]->TryPush(pending)) {
+            pending = nullptr;
+            num_pushed++;
+            progress = true;
+        }
+        MicroBatch *batch = nullptr;
+        while (queues_.back()->TryPop(&batch)) {
+            const Matrix<float> &result = batch->in;
+            CHECK(result.NumCols() == out->NumCols());
+            for (int r = 0; r < result.NumRows(); r++) {
+                memcpy(out->Data() + (batch->row + r) * out->Stride(), 
+                       result.Data() + r * result.Stride(),
+                       sizeof(float) * result.NumCols());
+            }
+            free.push_back(batch);
+            num_done++;
+            progress = true;
+        }
+        if (progress) {
+            backoff.Reset();
+        } else {
+            backoff.Wait();
+        }
+    }
+}
+
+std::vector<int> PipelineNet::PartitionByBytes(const XNet &net, 
+        int64_t max_stage_bytes) {
+    std::vector<int> begin(1, 0);
+    int64_t bytes = 0;
+    for (int i = 0; i < net.NumNodes(); i++) {
+        int64_t node_bytes = net.GetNode(i)->WeightBytes();
+        if (i > begin.back() && bytes + node_bytes > max_stage_bytes) {
+            begin.push_back(i);
+            bytes = 0;
+        }
+        bytes += node_bytes;
+    }
+    begin.push_back(net.NumNodes());
+    return begin;
+}
+
+std::vector<int> PipelineNet::PartitionByStages(const XNet &net, 
+        int num_stages) {
+    CHECK(num_stages > 0);
+    // Binary search the smallest max bytes of at most num_stages stages
+    int64_t low = 0, high = 0;
+    for (int i = 0; i < net.NumNodes(); i++) {
+        int64_t node_bytes = net.GetNode(i)->WeightBytes();
+        low = std::max(low, node_bytes);
+        high += node_bytes;
+    }
+    while (low < high) {
+        int64_t mid = low + (high - low) / 2;
+        if (PartitionByBytes(net, mid).size() - 1 <= num_stages) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return PartitionByBytes(net, low);
+}
+
+int64_t PipelineNet::L2CacheBytes() {
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    long bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (bytes > 0) return bytes;
+#endif
+    return 1 << 20;
+}
@@ -0,0 +1,80 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: layer pipelined forward, every stage runs a contiguous range of
+ *        the nodes on its own thread
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "xnet.h"
+#include "spsc-queue.h"
+
+// Usage:
+//   PipelineNet pipeline(net); // stages sized by the L2 cache
+//   pipeline.Forward(in, &out, 4); // micro-batches of 4 rows
+//
+// When the weights of a net do not fit in the cache of a core, a forward
+// streams all of them from memory for every batch. The pipeline gives
+// every stage(thread, pinned to a core with pin_threads) a contiguous
+// range of the nodes whose weights fit in its L2, and the micro-batches
+// flow from stage to stage by lock free SPSC queues, so the weights of a
+// stage stay hot in its cache and the stages work on different
+// micro-batches at the same time. It raises the throughput of a stream
+// of small batches, not the latency of one.
+//
+// Forward is not thread safe, the caller thread is the producer of the
+// first queue and the consumer of the last one. Idle stages spin, then
+// yield and sleep, until the pipeline is destroyed.
+class PipelineNet {
+public:
+    // num_stages 0 splits the nodes so the weights of every stage fit in
+    // the L2 cache, else into num_stages stages of balanced weight bytes.
+    // queue_size is the micro-batches a stage can run ahead of the next
+    // one. The nodes are copied(weights shared), so is the tune table.
+    explicit PipelineNet(const XNet &net, int num_stages = 0, 
+                         int queue_size = 4, bool pin_threads = false);
+    ~PipelineNet();
+    // Forward in by micro-batches of micro_batch rows, out gets all of
+    // them in order
+    void Forward(const Matrix<float> &in, Matrix<float> *out, 
+                 int micro_batch);
+    int NumStages() const { return stages_.size(); }
+    // [begin, end) of the nodes of stage i
+    int StageBegin(int i) const { return stage_begin_[i]; }
+    int StageEnd(int i) const { return stage_begin_[i + 1]; }
+    // Begin of every stage and the end of the last one, the weight bytes
+    // of a stage are at most max_stage_bytes unless it has one node
+    static std::vector<int> PartitionByBytes(const XNet &net, 
+                                             int64_t max_stage_bytes);
+    // Same as above with the smallest max_stage_bytes of at most 
+    // num_stages stages
+    static std::vector<int> PartitionByStages(const XNet &net, 
+                                              int num_stages);
+    // L2 cache size of the host, 1MB if unknown
+    static int64_t L2CacheBytes();
+private:
+    struct MicroBatch {
+        int64_t row;
+        Matrix<float> in, out;
+    };
+    typedef SpscQueue<MicroBatch *> Queue;
+    void RunStage(int i);
+    std::vector<int> stage_begin_;
+    std::vector<std::unique_ptr<XNet> > stages_;
+    // queues_[i] feeds stage i, the last one is the output
+    std::vector<std::unique_ptr<Queue> > queues_;
+    std::vector<std::unique_ptr<MicroBatch> > pool_;
+    std::vector<std::thread> threads_;
+    std::atomic<bool> stop_;
+    DISALLOW_COPY_AND_ASSIGN(PipelineNet);
+};
+
+#endif
@@ -0,0 +1,127 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ */
+
+#include <stdio.h>
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+#include "profiler.h"
+#include "utils.h"
+
+thread_local Profiler *Profiler::current_ = nullptr;
+
+static int64_t SteadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Profiler::Profiler(int max_trace_events): max_trace_events_(max_trace_events) {
+    Reset();
+}
+
+void Profiler::Reset() {
+    start_ns_ = SteadyNowNs();
+    names_.clear();
+    node_stats_.clear();
+    phase_stats_.clear();
+    events_.clear();
+    current_node_ = -1;
+    node_start_us_ = 0;
+}
+
+double Profiler::NowUs() const {
+    return (SteadyNowNs() - start_ns_) / 1000.0;
+}
+
+void Profiler::AddEvent(const std::string &name, double start_us,
+        double end_us) {
+    if (events_.size() >= max_trace_events_) return;
+    Event event = { name, start_us, end_us - start_us };
+    events_.push_back(event);
+}
+
+void Profiler::BeginNode(int id, const std::string &name) {
+    if (names_.find(id) == names_.end()) names_[id] = name;
+    current_node_ = id;
+    node_start_us_ = NowUs();
+}
+
+void Profiler::EndNode(int64_t flops, int64_t bytes_read,
+        int64_t bytes_written) {
+    CHECK(current_node_ >= 0);
+    double end_us = NowUs();
+    Stat &stat = node_stats_[current_node_];
+    stat.calls++;
+    stat.time_us += end_us - node_start_us_;
+    stat.flops += flops;
+    stat.bytes_read += bytes_read;
+    stat.bytes_written += bytes_written;
+    AddEvent(names_[current_node_], node_start_us_, end_us);
+    current_node_ = -1;
+}
+
+void Profiler::AddPhase(const char *phase, double start_us, double end_us) {
+    if (current_node_ < 0) return;
+    Stat &stat = phase_stats_[std::make_pair(current_node_,
+                                             std::string(phase))];
+    stat.calls++;
+    stat.time_us += end_us - start_us;
+    AddEvent(phase, start_us, end_us);
+}
+
+void Profiler::Report(std::ostream &os) const {
+    double total_us = 0;
+    for (auto it = node_stats_.begin(); it != node_stats_.end(); it++) {
+        total_us += it->second.time_us;
+    }
+    char line[256];
+    snprintf(line, sizeof(line), "%-32s %8s %10s %10s %7s %9s %9s %9s\n",
+             "Node", "Calls", "Time(ms)", "Avg(us)", "Time%", "GFLOP/s",
+             "MB read", "MB write");
+    os << line;
+    for (auto it = node_stats_.begin(); it != node_stats_.end(); it++) {
+        const Stat &stat = it->second;
+        snprintf(line, sizeof(line),
+                 "%-32s %8lld %10.3f %10.2f %6.2f%% %9.3f %9.2f %9.2f\n",
+                 names_.at(it->first).c_str(), (long long)stat.calls,
+                 stat.time_us / 1e3, stat.time_us / stat.calls,
+                 total_us > 0 ? 100.0 * stat.time_us / total_us : 0.0,
+                 stat.time_us > 0 ? stat.flops / stat.time_us / 1e3 : 0.0,
+                 stat.bytes_read / 1e6, stat.bytes_written / 1e6);
+        os << line;
+        auto phase = phase_stats_.lower_bound(
+            std::make_pair(it->first, std::string()));
+        for (; phase != phase_stats_.end() && phase->first.first == it->first;
+             phase++) {
+            const Stat &phase_stat = phase->second;
+            snprintf(line, sizeof(line), "  %-30s %8lld %10.3f %10.2f %6.2f%%\n",
+                     phase->first.second.c_str(), (long long)phase_stat.calls,
+                     phase_stat.time_us / 1e3,
+                     phase_stat.time_us / phase_stat.calls,
+                     total_us > 0 ? 100.0 * phase_stat.time_us / total_us : 0.0);
+            os << line;
+        }
+    }
+    snprintf(line, sizeof(line), "%-32s %8s %10.3f\n", "Total", "",
+             total_us / 1e3);
+    os << line;
+}
+
+void Profiler::WriteChromeTrace(const std::string &file) const {
+    std::ofstream os(file);
+    if (!os) {
+        ERROR("failed to write %s", file.c_str());
+    }
+    os << "{\"traceEvents\":[";
+    os << std::fixed << std::setprecision(3);
+    for (int i = 0; i < events_.size(); i++) {
+        if (i > 0) os << ",";
+        os << "\n{\"name\":\"" << events_[i].name << "\",\"ph\":\"X\""
+           << ",\"pid\":0,\"tid\":0,\"ts\":" << events_[i].start_us
+           << ",\"dur\":" << events_[i].dur_us << "}";
+    }
+    os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
@@ -0,0 +1,128 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ */
+
+#include <string.h>
+
+#include "result-cache.h"
+
+ResultCache::ResultCache(int64_t max_bytes, int num_shards):
+        max_bytes_(max_bytes) {
+    CHECK(max_bytes > 0);
+    CHECK(num_shards > 0);
+    max_shard_bytes_ = max_bytes / num_shards;
+    for (int i = 0; i < num_shards; i++) {
+        shards_.push_back(std::unique_ptr<Shard>(new Shard()));
+    }
+}
+
+uint64_t ResultCache::Hash(const float *x, int n, uint64_t tag) {
+    // Multiply and rotate 8 bytes at a time, then a final mix(the
+    // finalizer of murmur3), fast and good enough to spread the shards
+    const uint64_t k = 0x9e3779b97f4a7c15ULL;
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(x);
+    size_t size = sizeof(float) * n, i = 0;
+    uint64_t hash = (size + tag) * k;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash = ((hash ^ word) * k);
+        hash = (hash << 31) | (hash >> 33);
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        memcpy(&word, bytes + i, size - i);
+        hash = (hash ^ word) * k;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+bool ResultCache::Lookup(const float *in, int in_dim, float *out,
+        int out_dim, uint64_t tag) {
+    uint64_t hash = Hash(in, in_dim, tag);
+    Shard &shard = GetShard(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.map.find(hash);
+    if (it == shard.map.end() || it->second->tag != tag || 
+        it->second->in.size() != in_dim ||
+        it->second->out.size() != out_dim ||
+        memcmp(it->second->in.data(), in, sizeof(float) * in_dim) != 0) {
+        shard.misses++;
+        return false;
+    }
+    // Move to the front
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    memcpy(out, it->second->out.data(), sizeof(float) * out_dim);
+    shard.hits++;
+    return true;
+}
+
+void ResultCache::Insert(const float *in, int in_dim, const float *out,
+        int out_dim, uint64_t tag) {
+    int64_t bytes = EntryBytes(in_dim, out_dim);
+    if (bytes > max_shard_bytes_) return;
+    uint64_t hash = Hash(in, in_dim, tag);
+    Shard &shard = GetShard(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.map.find(hash);
+    if (it != shard.map.end()) {
+        // The same row inserted by another thread, or a collision
+        shard.bytes -= EntryBytes(it->second->in.size(),
+                                  it->second->out.size());
+        shard.lru.erase(it->second);
+        shard.map.erase(it);
+    }
+    while (!shard.lru.empty() && shard.bytes + bytes > max_shard_bytes_) {
+        const Entry &last = shard.lru.back();
+        shard.bytes -= EntryBytes(last.in.size(), last.out.size());
+        shard.map.erase(last.hash);
+        shard.lru.pop_back();
+        shard.evictions++;
+    }
+    Entry entry;
+    entry.hash = hash;
+    entry.tag = tag;
+    entry.in.assign(in, in + in_dim);
+    entry.out.assign(out, out + out_dim);
+    shard.lru.push_front(std::move(entry));
+    shard.map[hash] = shard.lru.begin();
+    shard.bytes += bytes;
+}
+
+void ResultCache::Clear() {
+    for (int i = 0; i < shards_.size(); i++) {
+        Shard &shard = *shards_[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.lru.clear();
+        shard.map.clear();
+        shard.bytes = 0;
+    }
+}
+
+int64_t ResultCache::Sum(int64_t Shard::*counter) const {
+    int64_t sum = 0;
+    for (int i = 0; i < shards_.size(); i++) {
+        std::lock_guard<std::mutex> lock(shards_[i]->mutex);
+        sum += (*shards_[i]).*counter;
+    }
+    return sum;
+}
+
+int64_t ResultCache::Bytes() const { return Sum(&Shard::bytes); }
+int64_t ResultCache::Hits() const { return Sum(&Shard::hits); }
+int64_t ResultCache::Misses() const { return Sum(&Shard::misses); }
+int64_t ResultCache::Evictions() const { return Sum(&Shard::evictions); }
+
+int64_t ResultCache::NumEntries() const {
+    int64_t num_entries = 0;
+    for (int i = 0; i < shards_.size(); i++) {
+        std::lock_guard<std::mutex> lock(shards_[i]->mutex);
+        num_entries += shards_[i]->lru.size();
+    }
+    return num_entries;
+}
@@ -0,0 +1,85 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: bounded LRU cache of the output rows of the input rows already
+ *        forwarded, shared by the threads of a net
+ */
+
+#ifndef RESULT_CACHE_H_
+#define RESULT_CACHE_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "utils.h"
+
+// Usage:
+//   ResultCache cache(64 << 20); // 64MB
+//   net.SetResultCache(&cache); // and on the replicas of the net
+//   net.Forward(in, &out); // the rows seen before are not forwarded
+//
+// The key is a 64 bit hash of the bytes of the input row, the input row
+// is kept in the entry too and compared on a hit, so a hash collision is
+// a miss, never a wrong output. The entries are split into shards by the
+// hash, every shard has its own lock and LRU list, so the threads rarely
+// wait on each other. The bytes of the rows and an estimate of the list
+// and map nodes count against max_bytes, the least recently used entries
+// of a shard are evicted when it is over its share.
+//
+// The outputs are only valid for one net, the tag tells the nets(eg: the
+// versions of a reloaded model) sharing a cache apart, an entry only hits
+// on the same tag. Clear the cache to free the entries of an old net.
+// The output of a row must not depend on the other rows of its batch, so
+// a net with a QuantizeFullyConnect(one input range per batch) can not
+// use a cache.
+class ResultCache {
+public:
+    explicit ResultCache(int64_t max_bytes, int num_shards = 16);
+    // Copy the output of the input row in to out and return true if it is
+    // in the cache
+    bool Lookup(const float *in, int in_dim, float *out, int out_dim, 
+                uint64_t tag = 0);
+    // Add or replace the output of the input row in
+    void Insert(const float *in, int in_dim, const float *out, int out_dim,
+                uint64_t tag = 0);
+    void Clear();
+    int64_t MaxBytes() const { return max_bytes_; }
+    int64_t Bytes() const;
+    int64_t NumEntries() const;
+    int64_t Hits() const;
+    int64_t Misses() const;
+    int64_t Evictions() const;
+    static uint64_t Hash(const float *x, int n, uint64_t tag = 0);
+private:
+    struct Entry {
+        uint64_t hash, tag;
+        std::vector<float> in, out;
+    };
+    typedef std::list<Entry>::iterator EntryIter;
+    struct Shard {
+        Shard(): bytes(0), hits(0), misses(0), evictions(0) {}
+        mutable std::mutex mutex;
+        std::list<Entry> lru; // most recently used first
+        std::unordered_map<uint64_t, EntryIter> map;
+        int64_t bytes, hits, misses, evictions;
+    };
+    // Bytes of an entry, the rows and the list and map nodes
+    static int64_t EntryBytes(int in_dim, int out_dim) {
+        return sizeof(float) * (in_dim + out_dim) + sizeof(Entry) + 64;
+    }
+    // The high bits, the map buckets take the low ones
+    Shard &GetShard(uint64_t hash) {
+        return *shards_[(hash >> 32) % shards_.size()];
+    }
+    // Sum of a counter of the shards
+    int64_t Sum(int64_t Shard::*counter) const;
+    int64_t max_bytes_, max_shard_bytes_;
+    std::vector<std::unique_ptr<Shard> > shards_;
+    DISALLOW_COPY_AND_ASSIGN(ResultCache);
+};
+
+#endif
@@ -0,0 +1,71 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: lock free single producer single consumer ring buffer
+ */
+
+#ifndef SPSC_QUEUE_H_
+#define SPSC_QUEUE_H_
+
+#include <stddef.h>
+
+#include <atomic>
+#include <vector>
+
+#include "utils.h"
+
+// One thread pushes and one thread pops, neither blocks: TryPush fails
+// when the queue is full and TryPop when it is empty. The head and the
+// tail are on their own cache lines, and each side caches the index of
+// the other one, so the cache line of the other side is only read when
+// the cached index says full/empty.
+template <class T>
+class SpscQueue {
+public:
+    // The capacity is rounded up to a power of 2
+    explicit SpscQueue(int capacity): head_(0), tail_cache_(0), 
+                                      tail_(0), head_cache_(0) {
+        CHECK(capacity > 0);
+        size_t size = 1;
+        while (size < capacity) size *= 2;
+        buffer_.resize(size);
+        mask_ = size - 1;
+    }
+    int Capacity() const { return buffer_.size(); }
+    // Producer only
+    bool TryPush(const T &item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ == buffer_.size()) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ == buffer_.size()) return false;
+        }
+        buffer_[tail & mask_] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+    // Consumer only
+    bool TryPop(T *item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_) return false;
+        }
+        *item = buffer_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+private:
+    std::vector<T> buffer_;
+    size_t mask_;
+    char padding0_[64];
+    // Consumer side
+    std::atomic<size_t> head_;
+    size_t tail_cache_;
+    char padding1_[64];
+    // Producer side
+    std::atomic<size_t> tail_;
+    size_t head_cache_;
+    char padding2_[64];
+    DISALLOW_COPY_AND_ASSIGN(SpscQueue);
+};
+
+#endif
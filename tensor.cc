@@ -1,6 +1,12 @@
 /* Created on 2017-12-05
  * Author: Binbin Zhang
  */
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+
 #include "tensor.h"
 
 #ifdef USE_BLAS
@@ -10,17 +16,24 @@
 PARSE_TYPE(float, FLOAT)
 PARSE_TYPE(int32_t, INT32)
 PARSE_TYPE(uint8_t, INT8)
+PARSE_TYPE(int16_t, INT16)
 
 template <class DType, int32_t Dim>
 void Tensor<DType, Dim>::Resize(const std::vector<int32_t> &shape) {
     CHECK(shape_.size() == Dim);
     CHECK(shape.size() == Dim);
+    if (!holder_ && data_ != nullptr) {
+        // Not owned data can not be reallocated
+        CHECK(shape == shape_);
+        return;
+    }
     int32_t size = GetShapeSize(shape);
-    if (size == 0 || size == this->Size()) return;
-    if (holder_ && data_ != nullptr) delete [] data_;
+    if (size != this->Size()) {
+        if (holder_ && data_ != nullptr) delete [] data_;
+        data_ = size > 0 ? new DType[size]() : nullptr;
+        holder_ = true;
+    }
     shape_ = shape;
-    data_ = new DType[size]();
-    holder_ = true;
 }
 
 template <class DType, int32_t Dim>
@@ -93,19 +106,51 @@ void Tensor<DType, Dim>::CopyFrom(const Tensor<DType, Dim> &tensor) {
     memcpy(data_, tensor.Data(), Size() * sizeof(DType));
 }
 
+template <typename DType>
+void Matrix<DType>::CopyFrom(const Matrix<DType> &mat) {
+    Resize(mat.NumRows(), mat.NumCols());
+    if (IsContiguous() && mat.IsContiguous()) {
+        memcpy(this->data_, mat.Data(), this->Size() * sizeof(DType));
+        return;
+    }
+    for (int i = 0; i < NumRows(); i++) {
+        memcpy(this->data_ + i * Stride(), mat.Data() + i * mat.Stride(), 
+               NumCols() * sizeof(DType));
+    }
+}
+
+template <typename DType>
+void Matrix<DType>::CopyFrom(const Tensor<DType, 2> &tensor) {
+    const Matrix<DType> *mat = dynamic_cast<const Matrix<DType> *>(&tensor);
+    if (mat != nullptr) {
+        CopyFrom(*mat);
+        return;
+    }
+    // A plain 2 dim tensor is contiguous
+    std::vector<int32_t> shape = tensor.Shape();
+    CopyFrom(Matrix<DType>(tensor.Data(), shape[0], shape[1]));
+}
+
 template <typename DType>
 Matrix<DType> Matrix<DType>::RowRange(int start, int length) const {
-    return Matrix<DType>(this->data_ + start * NumCols(), length, NumCols());
+    return Matrix<DType>(this->data_ + start * Stride(), length, NumCols(), 
+                         stride_);
 }
 
 template <typename DType>
 Vector<DType> Matrix<DType>::Row(int row) const {
-    return Vector<DType>(this->data_ + row * NumCols(), NumCols());
+    return Vector<DType>(this->data_ + row * Stride(), NumCols());
 }
 
 template <typename DType>
 void Matrix<DType>::Mul(const Matrix<DType> &mat1, const Matrix<DType> &mat2, 
         bool transpose, float alpha) {
+    MulBuiltin(mat1, mat2, transpose, alpha);
+}
+
+template <typename DType>
+void Matrix<DType>::MulBuiltin(const Matrix<DType> &mat1, 
+        const Matrix<DType> &mat2, bool transpose, float alpha) {
     if (!transpose) {
         CHECK(mat1.NumCols() == mat2.NumRows());
         CHECK(NumRows() == mat1.NumRows());
@@ -147,6 +192,42 @@ void Matrix<DType>::AddVec(const Vector<DType> &vec) {
     }
 }
 
+// Row by row with the add kernel
+template <>
+void Matrix<float>::AddVec(const Vector<float> &vec) {
+    CHECK(NumCols() == vec.Size());
+    const Kernels &kernels = GetKernels();
+    for (int i = 0; i < NumRows(); i++) {
+        kernels.add(vec.Data(), NumCols(), this->data_ + i * Stride());
+    }
+}
+
+template <>
+void Matrix<float>::MulBuiltin(const Matrix<float> &mat1, 
+        const Matrix<float> &mat2, bool transpose, float alpha) {
+    if (!transpose) {
+        CHECK(mat1.NumCols() == mat2.NumRows());
+        CHECK(NumRows() == mat1.NumRows());
+        CHECK(NumCols() == mat2.NumCols());
+        for (int i = 0; i < mat1.NumRows(); i++) {
+            for (int j = 0; j < mat2.NumCols(); j++) {
+                (*this)(i, j) *= alpha; 
+                for (int k = 0; k < mat1.NumCols(); k++) {
+                    (*this)(i, j) += mat1(i, k) * mat2(k, j); 
+                }
+            }
+        }
+    }
+    else {
+        CHECK(mat1.NumCols() == mat2.NumCols());
+        CHECK(NumRows() == mat1.NumRows());
+        CHECK(NumCols() == mat2.NumRows());
+        GetKernels().sgemm_nt(NumRows(), NumCols(), mat1.NumCols(), 
+            mat1.Data(), mat1.Stride(), mat2.Data(), mat2.Stride(), 
+            alpha, data_, Stride());
+    }
+}
+
 #ifdef USE_BLAS
 template <>
 void Matrix<float>::Mul(const Matrix<float> &mat1, const Matrix<float> &mat2, 
@@ -157,9 +238,20 @@ void Matrix<float>::Mul(const Matrix<float> &mat1, const Matrix<float> &mat2,
             NumRows() == mat1.NumRows() && NumCols() == mat2.NumRows()));
     cblas_sgemm(CblasRowMajor, CblasNoTrans, !transpose ? CblasNoTrans : CblasTrans,
                 NumRows(), NumCols(), mat1.NumCols(), 1.0, 
-                mat1.Data(), mat1.NumCols(), mat2.Data(), mat2.NumCols(),
-                alpha, data_, NumCols());
+                mat1.Data(), mat1.Stride(), mat2.Data(), mat2.Stride(),
+                alpha, data_, Stride());
+}
+
+void SetBlasNumThreads(int num_threads) {
+    // openblas_set_num_threads is not free, only call it on change
+    static std::atomic<int> current(0);
+    if (num_threads <= 0 || current.exchange(num_threads) == num_threads) {
+        return;
+    }
+    openblas_set_num_threads(num_threads);
 }
+#else
+void SetBlasNumThreads(int num_threads) {}
 #endif
 
 template <typename DType>
@@ -187,14 +279,6 @@ void Vector<DType>::Scale(float alpha) {
     }
 }
 
-static void FindMinMax(float *data, int n, float *min, float *max) {
-    *min = *max = data[0];
-    for (int i = 1; i < n; i++) {
-        if (data[i] > *max) *max = data[i];
-        if (data[i] < *min) *min = data[i];
-    }
-}
-
 static void ChooseQuantizationParams(float min, float max, 
         float *scale, uint8_t *zero_point) {
     min = std::min(min, 0.f);
@@ -221,26 +305,107 @@ static void ChooseQuantizationParams(float min, float max,
 void QuantizeData(float *src, int n, float *scale, 
         uint8_t *zero_point, uint8_t *dest) {
     float min, max;
-    FindMinMax(src, n, &min, &max);
+    const Kernels &kernels = GetKernels();
+    kernels.min_max(src, n, &min, &max);
     ChooseQuantizationParams(min, max, scale, zero_point);
-    for (int i = 0; i < n; i++) {
-        float point = (*zero_point) + src[i] / (*scale);  
-        float round_point = std::max(0.f, std::min(255.f, point));
-        dest[i] = static_cast<uint8_t>(round(round_point));
+    kernels.quantize(src, n, *scale, *zero_point, dest);
+}
+
+void QuantizeData(const Matrix<float> &src, float *scale, 
+        uint8_t *zero_point, Matrix<uint8_t> *dest) {
+    dest->Resize(src.NumRows(), src.NumCols());
+    if (src.IsContiguous() && dest->IsContiguous()) {
+        QuantizeData(src.Data(), src.Size(), scale, zero_point, dest->Data());
+        return;
+    }
+    const Kernels &kernels = GetKernels();
+    float min = 0, max = 0;
+    for (int i = 0; i < src.NumRows(); i++) {
+        float row_min, row_max;
+        kernels.min_max(src.Data() + i * src.Stride(), src.NumCols(), 
+                        &row_min, &row_max);
+        min = std::min(min, row_min);
+        max = std::max(max, row_max);
+    }
+    ChooseQuantizationParams(min, max, scale, zero_point);
+    for (int i = 0; i < src.NumRows(); i++) {
+        kernels.quantize(src.Data() + i * src.Stride(), src.NumCols(), 
+            *scale, *zero_point, dest->Data() + i * dest->Stride());
     }
 }
 
 void DequantizeData(int32_t *src, int n, float scale,
         uint8_t zero_point, float *dest) {
+    GetKernels().dequantize(src, n, scale, zero_point, dest);
+}
+
+void SparseMatrix::ToDense(Matrix<float> *dense) const {
+    dense->Resize(NumRows(), NumCols());
+    for (int r = 0; r < NumRows(); r++) {
+        float *row = dense->Data() + r * dense->Stride();
+        memset(row, 0, sizeof(float) * NumCols());
+        for (int64_t i = RowBegin(r); i < RowEnd(r); i++) {
+            row[index_[i]] += value_[i];
+        }
+    }
+}
+
+float PalettizeData(const float *src, int n, int codebook_size, 
+        int num_iters, float *codebook, uint8_t *index) {
+    CHECK(n > 0 && codebook_size > 0 && codebook_size <= 256);
+    // On sorted values a cluster is a range between the midpoints of the
+    // centers, its sum is a difference of the prefix sums
+    std::vector<float> sorted(src, src + n);
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<double> prefix(n + 1, 0);
+    for (int i = 0; i < n; i++) prefix[i + 1] = prefix[i] + sorted[i];
+    // Start from the centers of the quantiles
+    std::vector<float> centers(codebook_size);
+    for (int c = 0; c < codebook_size; c++) {
+        centers[c] = sorted[std::min<int64_t>(n - 1, 
+            (2LL * c + 1) * n / (2 * codebook_size))];
+    }
+    std::vector<int> begin(codebook_size + 1);
+    for (int iter = 0; iter < num_iters; iter++) {
+        begin[0] = 0;
+        begin[codebook_size] = n;
+        for (int c = 1; c < codebook_size; c++) {
+            float mid = 0.5f * (centers[c - 1] + centers[c]);
+            begin[c] = std::upper_bound(sorted.begin(), sorted.end(), mid) - 
+                       sorted.begin();
+        }
+        bool changed = false;
+        for (int c = 0; c < codebook_size; c++) {
+            // An empty cluster keeps its center
+            if (begin[c + 1] <= begin[c]) continue;
+            float center = (prefix[begin[c + 1]] - prefix[begin[c]]) / 
+                           (begin[c + 1] - begin[c]);
+            changed = changed || center != centers[c];
+            centers[c] = center;
+        }
+        if (!changed) break;
+    }
+    std::copy(centers.begin(), centers.end(), codebook);
+    double error = 0;
     for (int i = 0; i < n; i++) {
-        dest[i] = scale * (src[i] - zero_point);
+        int c = std::lower_bound(centers.begin(), centers.end(), src[i]) - 
+                centers.begin();
+        if (c == codebook_size || 
+            (c > 0 && src[i] - centers[c - 1] < centers[c] - src[i])) {
+            c--;
+        }
+        index[i] = static_cast<uint8_t>(c);
+        error += (src[i] - centers[c]) * (src[i] - centers[c]);
     }
+    return error / n;
 }
 
 template class Matrix<uint8_t>;
+template class Matrix<int16_t>;
 template class Matrix<int>;
 template class Matrix<float>;
 template class Vector<uint8_t>;
+template class Vector<int16_t>;
 template class Vector<int>;
 template class Vector<float>;
 
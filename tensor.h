@@ -5,12 +5,15 @@
 #ifndef TENSOR_H_
 #define TENSOR_H_
 
+#include <assert.h>
+
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "utils.h"
 #include "net.pb.h"
-#include "third_party/gemmlowp/public/gemmlowp.h"
+#include "kernels.h"
 
 template <class DType>
 class ParseType {
@@ -26,9 +29,30 @@ template <class DType, int32_t Dim>
 class Tensor {
 public:
     Tensor(DType *data=nullptr): data_(data), shape_(Dim, 0), holder_(false) {}
-    Tensor(const Tensor<DType, Dim> &tensor) {
+    Tensor(const Tensor<DType, Dim> &tensor): 
+            data_(nullptr), shape_(Dim, 0), holder_(false) {
         CopyFrom(tensor);
     }
+    // Take the data(owned or not) of tensor, tensor is left empty
+    Tensor(Tensor<DType, Dim> &&tensor): 
+            data_(tensor.data_), shape_(tensor.shape_), 
+            holder_(tensor.holder_) {
+        tensor.Release();
+    }
+    Tensor<DType, Dim> &operator = (const Tensor<DType, Dim> &tensor) {
+        if (this != &tensor) CopyFrom(tensor);
+        return *this;
+    }
+    Tensor<DType, Dim> &operator = (Tensor<DType, Dim> &&tensor) {
+        if (this != &tensor) {
+            if (holder_ && data_ != nullptr) delete [] data_;
+            data_ = tensor.data_;
+            shape_ = tensor.shape_;
+            holder_ = tensor.holder_;
+            tensor.Release();
+        }
+        return *this;
+    }
     ~Tensor() {
         if (holder_ && data_ != nullptr) delete [] data_;
     }
@@ -36,13 +60,18 @@ public:
     virtual void ToProto(TensorProto *proto) const;
     void Resize(const std::vector<int32_t> &shape);
     int32_t Size() const {
-        GetShapeSize(shape_);
+        return GetShapeSize(shape_);
     }
     DType *Data() const { return data_; } 
     std::vector<int32_t> Shape() const { return shape_; }
     virtual void CopyFrom(const Tensor<DType, Dim> &tensor); 
 protected:
     int32_t GetShapeSize(const std::vector<int32_t> &shape) const;
+    void Release() {
+        data_ = nullptr;
+        shape_.assign(Dim, 0);
+        holder_ = false;
+    }
 protected:
     DType *data_;
     std::vector<int32_t> shape_;
@@ -55,37 +84,72 @@ class Vector;
 template <class DType>
 class Matrix : public Tensor<DType, 2> {
 public:
-    Matrix(int32_t row = 0, int32_t col = 0) {
+    Matrix(int32_t row = 0, int32_t col = 0): stride_(0) {
         Resize(row, col);
     }
-    Matrix(DType *data, int32_t row, int32_t col): Tensor<DType, 2>(data) {
+    // A view of not owned data, stride is the distance of two rows,
+    // 0 means col. A view can not be resized to another shape.
+    Matrix(DType *data, int32_t row, int32_t col, int32_t stride = 0): 
+            Tensor<DType, 2>(data), stride_(stride) {
         CHECK(this->shape_.size() == 2);
+        CHECK(stride == 0 || stride >= col);
         this->shape_[0] = row;
         this->shape_[1] = col;
     }
+    Matrix(const Matrix<DType> &mat): stride_(0) {
+        CopyFrom(mat);
+    }
+    Matrix(Matrix<DType> &&mat): 
+            Tensor<DType, 2>(std::move(mat)), stride_(mat.stride_) {
+        mat.stride_ = 0;
+    }
+    Matrix<DType> &operator = (const Matrix<DType> &mat) {
+        if (this != &mat) CopyFrom(mat);
+        return *this;
+    }
+    Matrix<DType> &operator = (Matrix<DType> &&mat) {
+        if (this != &mat) {
+            Tensor<DType, 2>::operator = (std::move(mat));
+            stride_ = mat.stride_;
+            mat.stride_ = 0;
+        }
+        return *this;
+    }
     void Resize(int32_t row,int32_t col) {
         std::vector<int32_t> shape = { row, col };
         Tensor<DType, 2>::Resize(shape);
     }
     int32_t NumRows() const { return this->shape_[0]; }
     int32_t NumCols() const { return this->shape_[1]; }
+    int32_t Stride() const { return stride_ > 0 ? stride_ : NumCols(); }
+    bool IsContiguous() const { return Stride() == NumCols() || NumRows() <= 1; }
     const DType operator () (int r, int c) const {
         CHECK(r < NumRows());
         CHECK(c < NumCols());
-        return *(this->data_ + r * NumCols() + c);
+        return *(this->data_ + r * Stride() + c);
     }
     DType& operator () (int r, int c) {
         CHECK(r < NumRows());
         CHECK(c < NumCols());
-        return *(this->data_ + r * NumCols() + c);
+        return *(this->data_ + r * Stride() + c);
     }
+    // Row by row, both can be strided
+    void CopyFrom(const Matrix<DType> &mat);
+    // Overrides the one of Tensor, so a copy through Tensor keeps the
+    // strides too
+    void CopyFrom(const Tensor<DType, 2> &tensor);
     Vector<DType> Row(int row) const;
     Matrix<DType> RowRange(int start, int length) const;
 
     void Mul(const Matrix<DType> &mat1, const Matrix<DType> &mat2, 
              bool transpose = false, float alpha = 0.0);
+    // Same as Mul, but never use blas
+    void MulBuiltin(const Matrix<DType> &mat1, const Matrix<DType> &mat2, 
+                    bool transpose = false, float alpha = 0.0);
     void Transpose(const Matrix<DType> &mat);
     void AddVec(const Vector<DType> &vec);
+private:
+    int32_t stride_; // 0 for owned data, rows are contiguous
 };
 
 template <class DType>
@@ -115,35 +179,76 @@ public:
     void Scale(float alpha);
 };
 
+// Rows of (index, value) lists(csr), eg: hashed n-grams or categorical
+// ids of a high dim input, only the nonzeros are stored
+class SparseMatrix {
+public:
+    explicit SparseMatrix(int32_t col = 0): col_(col), row_begin_(1, 0) {}
+    void Clear() {
+        row_begin_.assign(1, 0);
+        index_.clear();
+        value_.clear();
+    }
+    // value nullptr means 1 for all, eg: one-hot or a bag of features
+    void AddRow(const int32_t *index, const float *value, int n) {
+        for (int i = 0; i < n; i++) {
+            CHECK(index[i] >= 0 && index[i] < col_);
+            index_.push_back(index[i]);
+            value_.push_back(value != nullptr ? value[i] : 1.0f);
+        }
+        row_begin_.push_back(index_.size());
+    }
+    int32_t NumRows() const { return row_begin_.size() - 1; }
+    int32_t NumCols() const { return col_; }
+    int64_t NumNonZeros() const { return index_.size(); }
+    // Nonzeros of row r are [RowBegin(r), RowEnd(r)) of Index() and Value()
+    int64_t RowBegin(int r) const { return row_begin_[r]; }
+    int64_t RowEnd(int r) const { return row_begin_[r + 1]; }
+    const int32_t *Index() const { return index_.data(); }
+    const float *Value() const { return value_.data(); }
+    void ToDense(Matrix<float> *dense) const;
+private:
+    int32_t col_;
+    std::vector<int64_t> row_begin_;
+    std::vector<int32_t> index_;
+    std::vector<float> value_;
+};
+
+// Set blas threads, <= 0 keeps the current setting, no-op without blas.
+// It is process wide and not safe while another thread is in a blas 
+// call, so set it once at load time, not per forward; nets which forward
+// on several threads at the same time should run blas on 1 thread.
+void SetBlasNumThreads(int num_threads);
+
 // Quantization Functions
 void QuantizeData(float *src, int n, float *scale, 
         uint8_t *zero_point, uint8_t *dest); 
 
+// Same as above on a maybe strided matrix, dest is resized to src
+void QuantizeData(const Matrix<float> &src, float *scale, 
+        uint8_t *zero_point, Matrix<uint8_t> *dest);
+
 void DequantizeData(int32_t *src, int n, float scale,
         uint8_t zero_point, float *dest); 
 
+// 1-D k-means of src into codebook_size(<= 256) centers, codebook gets
+// the sorted centers, index the nearest center of every value. Return the
+// mean squared error.
+float PalettizeData(const float *src, int n, int codebook_size, 
+        int num_iters, float *codebook, uint8_t *index);
+
 // @params transpose: if mat2 need transpose
+// @params num_threads: max threads, <= 0 means single thread
 template <bool transpose>
 void IntegerGemm(const Matrix<uint8_t> &mat1, const Matrix<uint8_t> &mat2, 
-        int offset1, int offset2, Matrix<int32_t> *out) {
+        int offset1, int offset2, Matrix<int32_t> *out, int num_threads = 0) {
     assert((!transpose && mat1.NumCols() == mat2.NumRows() && 
             out->NumRows() == mat1.NumRows() && out->NumCols() == mat2.NumCols()) ||
             (transpose && mat1.NumCols() == mat2.NumCols() && 
             out->NumRows() == mat1.NumRows() && out->NumCols() == mat2.NumRows()));
-    using namespace gemmlowp;
-    //left(right)-hand side
-    MatrixMap<const uint8_t, MapOrder::RowMajor> 
-        lhs(mat1.Data(), mat1.NumRows(), mat1.NumCols(), mat2.NumCols());
-    MatrixMap<const uint8_t, !transpose ? MapOrder::RowMajor : MapOrder::ColMajor> 
-        rhs(mat2.Data(), !transpose ? mat2.NumRows() : mat2.NumCols(), 
-        !transpose ? mat2.NumCols() : mat2.NumRows(), 
-        !transpose ? mat2.NumCols() : mat2.NumCols());
-    MatrixMap<int32_t, MapOrder::RowMajor>
-        result(out->Data(), out->NumRows(), out->NumCols(), out->NumCols());
-    const std::tuple<> empty_pipeline = {};
-    GemmContext context;
-    GemmWithOutputPipeline<uint8_t, int32_t, DefaultL8R8BitDepthParams>(
-        &context, lhs, rhs, &result, -offset1, -offset2, empty_pipeline);
+    GetKernels().u8_gemm(out->NumRows(), out->NumCols(), mat1.NumCols(), 
+        mat1.Data(), mat2.Data(), transpose, offset1, offset2, out->Data(), 
+        num_threads);
 }
 
 #endif
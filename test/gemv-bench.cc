@@ -0,0 +1,86 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: batch 1~4 latency of fully connect(gemm, bias, relu) by the blas,
+ *        builtin and gemv paths, p50 and p99 in us
+ */
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <random>
+
+#include "xnet.h"
+#include "../tools/parse-option.h"
+
+// Same steps as FullyConnect::Forward of every kernel
+static void Forward(int kernel, const Matrix<float> &in,
+        const Matrix<float> &weight, const Vector<float> &bias,
+        Matrix<float> *out) {
+    out->Resize(in.NumRows(), weight.NumRows());
+    if (kernel == KERNEL_GEMV) {
+        GetKernels().sgemv(in.NumRows(), weight.NumRows(), weight.NumCols(),
+            in.Data(), in.NumCols(), weight.Data(), bias.Data(),
+            ACTIVATION_RELU, out->Data(), out->NumCols());
+        return;
+    }
+    if (kernel == KERNEL_BUILTIN) {
+        out->MulBuiltin(in, weight, true);
+    } else {
+        out->Mul(in, weight, true);
+    }
+    out->AddVec(bias);
+    Activate(ACTIVATION_RELU, out->Data(), out->Size(), out->Data());
+}
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Benchmark small batch fully connect latency\n"
+                        "Usage: gemv-bench [options]\n";
+    ParseOptions option(usage);
+    int num_runs = 1000;
+    option.Register("num-runs", &num_runs, "runs of every shape and batch");
+    option.Read(argc, argv);
+
+    SetBlasNumThreads(1);
+    std::mt19937 generator(777);
+    std::uniform_real_distribution<float> distribution(-1.0, 1.0);
+    const int shapes[][2] = { {256, 784}, {1024, 1024},
+                              {2048, 2048}, {4096, 1024} };
+    const int kernels[] = { KERNEL_BLAS, KERNEL_BUILTIN, KERNEL_GEMV };
+    printf("%-12s %-6s %-8s %10s %10s %10s\n", "shape", "batch", "kernel",
+           "p50(us)", "p99(us)", "GB/s");
+    for (int s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        int n = shapes[s][0], k = shapes[s][1];
+        Matrix<float> weight(n, k);
+        Vector<float> bias(n);
+        for (int i = 0; i < weight.Size(); i++) {
+            weight.Data()[i] = distribution(generator);
+        }
+        for (int i = 0; i < bias.Size(); i++) {
+            bias.Data()[i] = distribution(generator);
+        }
+        for (int batch = 1; batch <= 4; batch++) {
+            Matrix<float> in(batch, k), out;
+            for (int i = 0; i < in.Size(); i++) {
+                in.Data()[i] = distribution(generator);
+            }
+            for (int t = 0; t < sizeof(kernels) / sizeof(kernels[0]); t++) {
+                Forward(kernels[t], in, weight, bias, &out); // warm up
+                std::vector<double> times(num_runs);
+                for (int r = 0; r < num_runs; r++) {
+                    Timer timer;
+                    Forward(kernels[t], in, weight, bias, &out);
+                    times[r] = timer.Elapsed();
+                }
+                std::sort(times.begin(), times.end());
+                double p50 = times[num_runs / 2],
+                       p99 = times[num_runs * 99 / 100];
+                char shape[32];
+                snprintf(shape, sizeof(shape), "%dx%d", n, k);
+                printf("%-12s %-6d %-8s %10.2f %10.2f %10.2f\n", shape, batch,
+                       KernelConfig(kernels[t]).ToString().c_str(), p50, p99,
+                       sizeof(float) * weight.Size() / p50 / 1e3);
+            }
+        }
+    }
+    return 0;
+}
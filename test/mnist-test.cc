@@ -4,68 +4,20 @@
 
 #include "xnet.h"
 #include "../tools/parse-option.h"
-
-int BigLittleSwap(int a) {
-    return ((((uint32_t)(a) & 0xff000000) >> 24) | \
-            (((uint32_t)(a) & 0x00ff0000) >> 8) | \
-            (((uint32_t)(a) & 0x0000ff00) << 8) | \
-            (((uint32_t)(a) & 0x000000ff) << 24));
-}
-
-void ReadMnistLabel(std::string filename, std::vector<int> *label) {
-    std::ifstream is(filename, std::ios::binary);
-    if (is.fail()) {
-       ERROR("read file %s error, check!!!", filename.c_str()); 
-    }
-    int magic = 0, num_images = 0;
-    is.read((char *)&magic, 4);
-    is.read((char *)&num_images, 4);
-    magic = BigLittleSwap(magic);
-    num_images = BigLittleSwap(num_images);
-    std::cout << magic << " " << num_images << "\n";
-    label->resize(num_images);
-    unsigned char digit = 0;
-    for (int i = 0; i < num_images; i++) {
-        is.read((char *)&digit, 1);
-        (*label)[i] = static_cast<int>(digit);
-        //std::cout << (*label)[i] << "\n";
-    }
-}
-
-void ReadMnistImage(std::string filename, Matrix<float> *data) {
-    std::ifstream is(filename, std::ios::binary);
-    if (is.fail()) {
-       ERROR("read file %s error, check!!!", filename.c_str()); 
-    }
-    int magic = 0, num_images = 0;
-    is.read((char *)&magic, 4);
-    is.read((char *)&num_images, 4);
-    magic = BigLittleSwap(magic);
-    num_images = BigLittleSwap(num_images);
-    std::cout << magic << " " << num_images << "\n";
-    int rows = 0, cols = 0;
-    is.read((char *)&rows, 4);
-    is.read((char *)&cols, 4);
-    rows = BigLittleSwap(rows);
-    cols = BigLittleSwap(cols);
-    std::cout << rows << " " << cols << "\n";
-    data->Resize(num_images, rows * cols);
-    unsigned char digit = 0;
-    for (int i = 0; i < num_images; i++) {
-        for (int j = 0; j < rows * cols; j++) {
-            is.read((char *)&digit, 1);
-            (*data)(i, j) = static_cast<float>(digit) / 255;
-            //std::cout << static_cast<int>(digit) << " ";
-        }
-        //std::cout << "\n";
-    }
-}
+#include "../tools/mnist-reader.h"
 
 int main(int argc, char *argv[]) {
     const char *usage = "Simple test on mnist data\n";
     ParseOptions option(usage);
     int batch = 32;
+    bool profile = false;
+    std::string trace_file = "", tune_file = "";
     option.Register("batch", &batch, "batch size for net forward");
+    option.Register("profile", &profile, "print per node profile");
+    option.Register("trace-file", &trace_file, 
+        "write chrome trace json to the file, implies --profile");
+    option.Register("tune-file", &tune_file, 
+        "use the kernels tuned by xnet-tune");
     option.Read(argc, argv);
 
     if (option.NumArgs() != 3) {
@@ -78,7 +30,18 @@ int main(int argc, char *argv[]) {
                 label_file = option.GetArg(3);
     
     XNet net(net_file);
+    // The net gives the argmax directly
+    net.SetOutputHead(OutputHead(OutputHeadParameter::TOP_K, 1));
     net.Info();
+    if (tune_file != "") {
+        TuneTable table;
+        table.Read(tune_file);
+        net.SetTuneTable(table);
+    }
+    Profiler profiler;
+    if (profile || trace_file != "") {
+        net.SetProfiler(&profiler);
+    }
     std::vector<int> label;
     Matrix<float> data;
     ReadMnistLabel(label_file, &label);
@@ -87,29 +50,22 @@ int main(int argc, char *argv[]) {
     int num_images = label.size(), num_correct = 0;
     for (int i = 0; i < num_images; i += batch) {
         int real_batch = i + batch < num_images ? batch : num_images - i; 
-        Matrix<float> in(real_batch, data.NumCols()), out;
-        // copy
-        for (int m = 0; m < in.NumRows(); m++) {
-            for (int n = 0; n < in.NumCols(); n++) {
-                in(m, n) = data(i+m, n);
-            }
-        }
-
-        net.Forward(in, &out);
+        Matrix<float> out(real_batch, net.OutputDim(data.NumCols()));
+        // Run on the rows of data directly, no copy
+        net.Forward(data.Data() + i * data.NumCols(), real_batch, 
+                    data.NumCols(), data.NumCols(), out.Data(), out.NumCols());
 
         for (int m = 0; m < out.NumRows(); m++) {
-            float max = out(m, 0);
-            int max_idx = 0;
-            for (int n = 1; n < out.NumCols(); n++) {
-                if (out(m, n) > max) {
-                    max = out(m, n);
-                    max_idx = n;
-                }
-            }
-            if (max_idx == label[i+m]) num_correct++;
+            if (static_cast<int>(out(m, 0)) == label[i+m]) num_correct++;
         }
     }
     printf("Accuracy %.6lf\n", static_cast<double>(num_correct) / num_images);
+    if (profile || trace_file != "") {
+        profiler.Report(std::cout);
+    }
+    if (trace_file != "") {
+        profiler.WriteChromeTrace(trace_file);
+    }
     return 0;
 }
 
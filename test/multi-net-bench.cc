@@ -0,0 +1,110 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: rows/s of several random relu nets on the same input, one
+ *        XNet::Forward per net against MultiNet, and the max difference
+ *        of the outputs
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <random>
+
+#include "xnet.h"
+#include "multi-net.h"
+#include "../tools/parse-option.h"
+
+static Node *RandomFullyConnect(int rows, int cols, ActivationType act,
+        std::mt19937 *generator) {
+    std::uniform_real_distribution<float> distribution(-1.0, 1.0);
+    NodeProto proto;
+    proto.set_node_type(NodeProto::FULLY_CONNECT);
+    Matrix<float> weight(rows, cols);
+    for (int i = 0; i < weight.Size(); i++) {
+        weight.Data()[i] = distribution(*generator) / sqrt(cols);
+    }
+    Vector<float> bias(rows);
+    for (int i = 0; i < bias.Size(); i++) {
+        bias.Data()[i] = distribution(*generator) * 0.1f;
+    }
+    weight.ToProto(proto.mutable_fully_connect_param()->mutable_weight());
+    bias.ToProto(proto.mutable_fully_connect_param()->mutable_bias());
+    Node *node = new FullyConnect();
+    node->FromProto(proto);
+    node->FuseActivation(act);
+    return node;
+}
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Benchmark fused forward of nets on the same input\n"
+                        "Usage: multi-net-bench [options]\n";
+    ParseOptions option(usage);
+    int num_nets = 4, input_dim = 512, hidden_dim = 128, output_dim = 16,
+        num_layers = 2, num_runs = 200;
+    option.Register("num-nets", &num_nets, "nets on the same input");
+    option.Register("input-dim", &input_dim, "input dim");
+    option.Register("hidden-dim", &hidden_dim, "hidden dim of every net");
+    option.Register("output-dim", &output_dim, "output dim of every net");
+    option.Register("num-layers", &num_layers, "fully connect layers of "
+        "every net");
+    option.Register("num-runs", &num_runs, "runs of every batch size");
+    option.Read(argc, argv);
+
+    SetBlasNumThreads(1);
+    std::mt19937 generator(777);
+    std::vector<XNet> nets(num_nets);
+    std::vector<const XNet *> net_ptrs;
+    for (int n = 0; n < num_nets; n++) {
+        for (int l = 0; l < num_layers; l++) {
+            bool last = l == num_layers - 1;
+            nets[n].AddNode(RandomFullyConnect(
+                last ? output_dim : hidden_dim,
+                l == 0 ? input_dim : hidden_dim,
+                last ? ACTIVATION_NONE : ACTIVATION_RELU, &generator));
+        }
+        net_ptrs.push_back(&nets[n]);
+    }
+    MultiNet multi(net_ptrs);
+    printf("%d nets of %d layers, input %d hidden %d output %d, "
+           "%d fused in %d groups\n", num_nets, num_layers, input_dim,
+           hidden_dim, output_dim, multi.NumFused(), multi.NumGroups());
+    printf("%-8s %14s %14s %12s\n", "batch", "separate rows/s",
+           "fused rows/s", "max diff");
+    const int batches[] = { 1, 4, 16, 64 };
+    std::uniform_real_distribution<float> distribution(-1.0, 1.0);
+    for (int b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+        int batch = batches[b];
+        Matrix<float> in(batch, input_dim);
+        for (int i = 0; i < in.Size(); i++) {
+            in.Data()[i] = distribution(generator);
+        }
+        std::vector<Matrix<float> > expected(num_nets), outs;
+        for (int n = 0; n < num_nets; n++) nets[n].Forward(in, &expected[n]);
+        Timer timer;
+        for (int r = 0; r < num_runs; r++) {
+            for (int n = 0; n < num_nets; n++) {
+                nets[n].Forward(in, &expected[n]);
+            }
+        }
+        double separate = num_runs * batch / (timer.Elapsed() / 1e6);
+        multi.Forward(in, &outs);
+        timer.Reset();
+        for (int r = 0; r < num_runs; r++) multi.Forward(in, &outs);
+        double fused = num_runs * batch / (timer.Elapsed() / 1e6);
+        float max_diff = 0;
+        for (int n = 0; n < num_nets; n++) {
+            CHECK(outs[n].NumRows() == batch);
+            CHECK(outs[n].NumCols() == output_dim);
+            for (int i = 0; i < outs[n].Size(); i++) {
+                max_diff = std::max(max_diff, fabsf(outs[n].Data()[i] -
+                                                    expected[n].Data()[i]));
+            }
+        }
+        printf("%-8d %14.1f %14.1f %12g\n", batch, separate, fused,
+               max_diff);
+        // The wide gemm only sums in another order at most
+        CHECK(max_diff <= 1e-4);
+    }
+    return 0;
+}
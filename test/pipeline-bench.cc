@@ -0,0 +1,90 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: rows/s of a stream of micro-batches through a random relu net,
+ *        XNet::Forward on one thread against PipelineNet of 1, 2, 4...
+ *        stages, and the max difference of the outputs
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <random>
+
+#include "xnet.h"
+#include "pipeline.h"
+#include "../tools/parse-option.h"
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Benchmark layer pipelined forward\n"
+                        "Usage: pipeline-bench [options]\n";
+    ParseOptions option(usage);
+    int dim = 1024, num_layers = 8, micro_batch = 4, num_rows = 4096,
+        max_stages = 8;
+    bool pin_threads = true;
+    option.Register("dim", &dim, "input and output dim of every layer");
+    option.Register("num-layers", &num_layers, "fully connect layers");
+    option.Register("micro-batch", &micro_batch, "rows of a micro-batch");
+    option.Register("num-rows", &num_rows, "rows of the stream");
+    option.Register("max-stages", &max_stages, "stages 1, 2, 4... up to it");
+    option.Register("pin-threads", &pin_threads, "pin the stages to cores");
+    option.Read(argc, argv);
+
+    SetBlasNumThreads(1);
+    std::mt19937 generator(777);
+    std::uniform_real_distribution<float> distribution(-1.0, 1.0);
+    XNet net;
+    for (int l = 0; l < num_layers; l++) {
+        NodeProto proto;
+        proto.set_node_type(NodeProto::FULLY_CONNECT);
+        Matrix<float> weight(dim, dim);
+        for (int i = 0; i < weight.Size(); i++) {
+            weight.Data()[i] = distribution(generator) / sqrt(dim);
+        }
+        weight.ToProto(proto.mutable_fully_connect_param()->mutable_weight());
+        Node *node = new FullyConnect();
+        node->FromProto(proto);
+        node->FuseActivation(ACTIVATION_RELU);
+        net.AddNode(node);
+    }
+    Matrix<float> in(num_rows, dim), expected, out;
+    for (int i = 0; i < in.Size(); i++) {
+        in.Data()[i] = distribution(generator);
+    }
+
+    printf("%d layers %dx%d, %.2f MB weight, L2 %.2f MB, micro-batch %d\n",
+           num_layers, dim, dim, 4.0 * dim * dim * num_layers / (1 << 20),
+           PipelineNet::L2CacheBytes() / static_cast<double>(1 << 20),
+           micro_batch);
+    printf("%-10s %12s %12s\n", "stages", "rows/s", "max diff");
+    Timer timer;
+    expected.Resize(num_rows, dim);
+    for (int r = 0; r < num_rows; r += micro_batch) {
+        int rows = std::min(micro_batch, num_rows - r);
+        Matrix<float> batch_out;
+        net.Forward(in.RowRange(r, rows), &batch_out);
+        for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < dim; j++) expected(r + i, j) = batch_out(i, j);
+        }
+    }
+    printf("%-10s %12.1f %12s\n", "none", num_rows / (timer.Elapsed() / 1e6),
+           "-");
+    for (int stages = 1; stages <= std::min(max_stages, num_layers); 
+         stages *= 2) {
+        PipelineNet pipeline(net, stages, 4, pin_threads);
+        pipeline.Forward(in.RowRange(0, micro_batch), &out, micro_batch);
+        Timer timer;
+        pipeline.Forward(in, &out, micro_batch);
+        double rows_per_second = num_rows / (timer.Elapsed() / 1e6);
+        float max_diff = 0;
+        for (int i = 0; i < out.Size(); i++) {
+            max_diff = std::max(max_diff, 
+                                fabsf(out.Data()[i] - expected.Data()[i]));
+        }
+        printf("%-10d %12.1f %12g\n", pipeline.NumStages(), rows_per_second,
+               max_diff);
+        // Same nodes on the same micro-batches, only the threads differ
+        CHECK(max_diff <= 1e-5);
+    }
+    return 0;
+}
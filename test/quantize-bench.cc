@@ -0,0 +1,136 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: GB/s of the quantize and dequantize steps of the int8 fully
+ *        connect for every cpu level, generic is the scalar baseline,
+ *        dequantize+add+relu is the unfused output step. The outputs of
+ *        every level are checked against the generic ones.
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <functional>
+#include <random>
+
+#include "kernels.h"
+#include "utils.h"
+#include "../tools/parse-option.h"
+
+// The scale of the check saturates the large inputs on both ends
+static const float kCheckScale = 0.005f;
+
+// Check the kernels of a level give the outputs of the generic ones, the
+// same min/max and bytes(rounding and saturation), and the same floats up
+// to the rounding of a fused multiply add
+static void CheckKernels(const Kernels &kernels, const std::string &name,
+        const std::vector<float> &src, const std::vector<float> &bias,
+        const std::vector<int32_t> &acc) {
+    Kernels generic = GetKernels(CPU_GENERIC);
+    int n = src.size();
+    float min, max, expected_min, expected_max;
+    kernels.min_max(src.data(), n, &min, &max);
+    generic.min_max(src.data(), n, &expected_min, &expected_max);
+    CHECK(min == expected_min && max == expected_max);
+    std::vector<uint8_t> quantized(n), expected_quantized(n);
+    kernels.quantize(src.data(), n, kCheckScale, 128, quantized.data());
+    generic.quantize(src.data(), n, kCheckScale, 128, 
+                     expected_quantized.data());
+    CHECK(quantized == expected_quantized);
+    std::vector<float> dest(n), expected(n);
+    float max_diff = 0;
+    const ActivationType acts[] = { ACTIVATION_NONE, ACTIVATION_RELU };
+    for (int a = 0; a < sizeof(acts) / sizeof(acts[0]); a++) {
+        for (int with_bias = 0; with_bias < 2; with_bias++) {
+            const float *b = with_bias ? bias.data() : nullptr;
+            kernels.dequantize_bias(acc.data(), n, 1e-4f, b, acts[a], 
+                                    dest.data());
+            generic.dequantize_bias(acc.data(), n, 1e-4f, b, acts[a], 
+                                    expected.data());
+            for (int i = 0; i < n; i++) {
+                max_diff = std::max(max_diff, fabsf(dest[i] - expected[i]));
+            }
+        }
+    }
+    printf("%-8d %-10s %-24s %10g\n", n, name.c_str(), 
+           "dequantize_bias max diff", max_diff);
+    CHECK(max_diff <= 1e-5);
+}
+
+// Median GB/s of func moving bytes per run
+static double Benchmark(const std::function<void()> &func, int64_t bytes,
+        int num_runs) {
+    func(); // warm up
+    std::vector<double> times(num_runs);
+    for (int r = 0; r < num_runs; r++) {
+        Timer timer;
+        func();
+        times[r] = timer.Elapsed();
+    }
+    std::sort(times.begin(), times.end());
+    return bytes / times[num_runs / 2] / 1e3;
+}
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Benchmark the quantize and dequantize kernels\n"
+                        "Usage: quantize-bench [options]\n";
+    ParseOptions option(usage);
+    int num_runs = 200;
+    option.Register("num-runs", &num_runs, "runs of every kernel and size");
+    option.Read(argc, argv);
+
+    std::mt19937 generator(777);
+    std::uniform_real_distribution<float> distribution(-1.0, 1.0);
+    const int sizes[] = { 1024, 16384, 262144 };
+    printf("%-8s %-10s %-24s %10s\n", "n", "level", "kernel", "GB/s");
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int n = sizes[s];
+        std::vector<float> src(n), bias(n), dest(n);
+        std::vector<int32_t> acc(n);
+        std::vector<uint8_t> quantized(n);
+        for (int i = 0; i < n; i++) {
+            src[i] = distribution(generator);
+            bias[i] = distribution(generator);
+            acc[i] = static_cast<int32_t>(distribution(generator) * 1e5);
+        }
+        for (int level = CPU_GENERIC; level <= DetectCpuLevel(); level++) {
+            Kernels kernels = GetKernels(static_cast<CpuLevel>(level));
+            std::string name = CpuLevelToString(static_cast<CpuLevel>(level));
+            float min, max;
+            double min_max = Benchmark([&]() {
+                kernels.min_max(src.data(), n, &min, &max);
+            }, sizeof(float) * n, num_runs);
+            double quantize = Benchmark([&]() {
+                kernels.quantize(src.data(), n, 0.01f, 128, quantized.data());
+            }, (sizeof(float) + 1) * n, num_runs);
+            // The min/max and quantize passes of QuantizeData
+            double quantize_data = Benchmark([&]() {
+                kernels.min_max(src.data(), n, &min, &max);
+                kernels.quantize(src.data(), n, 0.01f, 128, quantized.data());
+            }, (2 * sizeof(float) + 1) * n, num_runs);
+            // Dequantize, add the bias and relu, three passes over the 
+            // output, both count the bytes of one pass to compare the time
+            double dequantize_add = Benchmark([&]() {
+                kernels.dequantize(acc.data(), n, 1e-4f, 0, dest.data());
+                kernels.add(bias.data(), n, dest.data());
+                kernels.relu(dest.data(), n, dest.data());
+            }, 3 * sizeof(float) * n, num_runs);
+            double dequantize_bias = Benchmark([&]() {
+                kernels.dequantize_bias(acc.data(), n, 1e-4f, bias.data(),
+                                        ACTIVATION_RELU, dest.data());
+            }, 3 * sizeof(float) * n, num_runs);
+            printf("%-8d %-10s %-24s %10.2f\n", n, name.c_str(), "min_max",
+                   min_max);
+            printf("%-8d %-10s %-24s %10.2f\n", n, name.c_str(), "quantize",
+                   quantize);
+            printf("%-8d %-10s %-24s %10.2f\n", n, name.c_str(),
+                   "min_max+quantize", quantize_data);
+            printf("%-8d %-10s %-24s %10.2f\n", n, name.c_str(),
+                   "dequantize+add+relu", dequantize_add);
+            printf("%-8d %-10s %-24s %10.2f\n", n, name.c_str(),
+                   "dequantize_bias+relu", dequantize_bias);
+            CheckKernels(kernels, name, src, bias, acc);
+        }
+    }
+    return 0;
+}
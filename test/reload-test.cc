@@ -0,0 +1,91 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: reload a model again and again under Forward threads by
+ *        ModelHandle, and check the old versions are freed(the RSS does
+ *        not grow by their weights)
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <fstream>
+#include <random>
+#include <thread>
+
+#include "model-handle.h"
+#include "../tools/parse-option.h"
+
+// Resident bytes of the process
+static int64_t ResidentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    int64_t size = 0, resident = 0;
+    statm >> size >> resident;
+    CHECK(statm.good());
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Check ModelHandle frees the replaced versions\n"
+                        "Usage: reload-test [options]\n";
+    ParseOptions option(usage);
+    int dim = 1024, num_reloads = 8, num_threads = 4;
+    std::string net_file = "/tmp/reload-test.net";
+    option.Register("dim", &dim, "input and output dim of the net");
+    option.Register("num-reloads", &num_reloads, "loads after the first");
+    option.Register("num-threads", &num_threads, "Forward threads");
+    option.Register("net-file", &net_file, "where the random net is saved");
+    option.Read(argc, argv);
+
+    std::mt19937 generator(777);
+    std::uniform_real_distribution<float> distribution(-1.0, 1.0);
+    {
+        NodeProto proto;
+        proto.set_node_type(NodeProto::FULLY_CONNECT);
+        Matrix<float> weight(dim, dim);
+        for (int i = 0; i < weight.Size(); i++) {
+            weight.Data()[i] = distribution(generator) / sqrt(dim);
+        }
+        weight.ToProto(proto.mutable_fully_connect_param()->mutable_weight());
+        XNet net;
+        Node *node = new FullyConnect();
+        node->FromProto(proto);
+        net.AddNode(node);
+        net.ToProto(net_file);
+    }
+    int64_t weight_bytes = sizeof(float) * dim * dim;
+
+    ModelHandle model(dim, 4);
+    CHECK(model.Load(net_file));
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.push_back(std::thread([&]() {
+            Matrix<float> in(4, dim), out;
+            for (int i = 0; i < in.Size(); i++) in.Data()[i] = 0.5f;
+            while (!stop) model.Forward(in, &out);
+        }));
+    }
+    // The buffers of the first loads settle, then every load replaces a
+    // version of the same size
+    CHECK(model.Load(net_file));
+    int64_t base = ResidentBytes();
+    printf("%-8s %12s %12s\n", "reload", "ms", "RSS MB");
+    for (int i = 0; i < num_reloads; i++) {
+        Timer timer;
+        CHECK(model.Load(net_file));
+        int64_t rss = ResidentBytes();
+        printf("%-8d %12.1f %12.1f\n", i, timer.Elapsed() / 1e3, rss / 1e6);
+    }
+    stop = true;
+    for (int t = 0; t < num_threads; t++) threads[t].join();
+    int64_t growth = ResidentBytes() - base;
+    printf("RSS growth %.1f MB, weight %.1f MB\n", growth / 1e6,
+           weight_bytes / 1e6);
+    // A leaked version keeps its weight, all of them would be
+    // num_reloads * weight_bytes
+    CHECK(growth < weight_bytes);
+    unlink(net_file.c_str());
+    return 0;
+}
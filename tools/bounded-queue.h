@@ -0,0 +1,61 @@
+// Created on 2026-10-19
+// Author: Binbin Zhang
+// About: blocking queue of bounded capacity between pipeline stages
+
+#ifndef BOUNDED_QUEUE_H_
+#define BOUNDED_QUEUE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+#include "utils.h"
+
+// Push blocks while the queue is full, so a fast stage can not run ahead
+// of a slow one by more than capacity items. The producer(s) Close the
+// queue at the end, Pop returns false once it is closed and drained.
+template <class T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(int capacity): capacity_(capacity), closed_(false) {
+        CHECK(capacity > 0);
+    }
+    // Return false if the queue is closed, item is dropped then
+    bool Push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this]() {
+            return closed_ || queue_.size() < capacity_;
+        });
+        if (closed_) return false;
+        queue_.push_back(std::move(item));
+        not_empty_.notify_one();
+        return true;
+    }
+    bool Pop(T *item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this]() {
+            return closed_ || !queue_.empty();
+        });
+        if (queue_.empty()) return false;
+        *item = std::move(queue_.front());
+        queue_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+    void Close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+private:
+    int capacity_;
+    bool closed_;
+    std::deque<T> queue_;
+    std::mutex mutex_;
+    std::condition_variable not_full_, not_empty_;
+    DISALLOW_COPY_AND_ASSIGN(BoundedQueue);
+};
+
+#endif
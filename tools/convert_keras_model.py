@@ -40,6 +40,11 @@ def parse_activation_type(act):
     else:
         error_msg('activation %s is not supported' % act)
 
+def add_tensor(tensor, ndarray):
+    tensor.data_type = net_pb2.TensorProto.FLOAT
+    tensor.shape.extend(list(ndarray.shape))
+    tensor.float_data.extend(convert_ndarray_to_list(ndarray))
+
 def convert_keras_model_to_net(model, xnet_model):
     layers = model.layers
     ref_count = {}
@@ -77,8 +82,27 @@ def convert_keras_model_to_net(model, xnet_model):
                 xnet_node.node_type = parse_activation_type(act)
         elif class_name == 'Activation':
             act = layer.activation.__name__
-            xnet_node.name = '%s%d' % (act, add_new_node(act))
-            xnet_node.node_type = parse_activation_type(act)
+            if act == 'linear':
+                xnet_node.name = 'identity%d' % add_new_node('identity')
+                xnet_node.node_type = net_pb2.NodeProto.IDENTITY
+            else:
+                xnet_node.name = '%s%d' % (act, add_new_node(act))
+                xnet_node.node_type = parse_activation_type(act)
+        elif class_name == 'BatchNormalization':
+            # Folded into the Dense before it when xnet loads the net
+            xnet_node.name = 'batch_norm%d' % add_new_node('batch_norm')
+            xnet_node.node_type = net_pb2.NodeProto.BATCH_NORM
+            param = xnet_node.batch_norm_param
+            add_tensor(param.mean, layer.moving_mean.get_value())
+            add_tensor(param.variance, layer.moving_variance.get_value())
+            if layer.gamma is not None:
+                add_tensor(param.gamma, layer.gamma.get_value())
+            if layer.beta is not None:
+                add_tensor(param.beta, layer.beta.get_value())
+            param.epsilon = layer.epsilon
+        elif class_name == 'Dropout':
+            xnet_node.name = 'identity%d' % add_new_node('identity')
+            xnet_node.node_type = net_pb2.NodeProto.IDENTITY
         else:
             error_msg('error, layer %s %s is supported' % (layer_name, class_name))
 
@@ -0,0 +1,53 @@
+// Created on 2026-10-19
+// Author: Binbin Zhang
+// About: convert the fully connect nodes of a float net to binary or
+//        ternary ones, 1 or 2 bits per weight
+#include <stdio.h>
+
+#include <sstream>
+
+#include "xnet.h"
+#include "parse-option.h"
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Convert float net to binary/ternary net\n"
+        "eg: xnet-binarize --ternary --nodes=1,2 float.proto binary.proto\n";
+    ParseOptions option(usage);
+    bool ternary = false;
+    int input_bits = 4;
+    std::string nodes = "";
+    option.Register("ternary", &ternary, "ternary weight, else binary");
+    option.Register("input-bits", &input_bits, "bits of the quantized "
+        "input, 1~8, 1 is the sign of the input(xnor net)");
+    option.Register("nodes", &nodes, "indices of the fully connect nodes "
+        "to convert, comma separated, empty for all. The first and the "
+        "last layers usually lose the most accuracy.");
+    option.Read(argc, argv);
+    if (option.NumArgs() != 2 || input_bits < 1 || input_bits > 8) {
+        option.PrintUsage();
+        exit(1);
+    }
+    std::string float_net_file = option.GetArg(1),
+        binary_net_file = option.GetArg(2);
+
+    XNet net(float_net_file), binary_net;
+    std::vector<bool> mask(net.NumNodes(), nodes.empty());
+    std::stringstream ss(nodes);
+    std::string id;
+    while (std::getline(ss, id, ',')) {
+        int i = atoi(id.c_str());
+        if (i < 0 || i >= net.NumNodes()) ERROR("no node %d", i);
+        mask[i] = true;
+    }
+    net.Binarize(mask, ternary, input_bits, &binary_net);
+    binary_net.ToProto(binary_net_file);
+    binary_net.Info();
+    int64_t float_bytes = 0, binary_bytes = 0;
+    for (int i = 0; i < net.NumNodes(); i++) {
+        float_bytes += net.GetNode(i)->WeightBytes();
+        binary_bytes += binary_net.GetNode(i)->WeightBytes();
+    }
+    printf("weight %lld -> %lld bytes\n", static_cast<long long>(float_bytes),
+           static_cast<long long>(binary_bytes));
+    return 0;
+}
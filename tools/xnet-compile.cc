@@ -0,0 +1,402 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: ahead of time compile a net to a standalone c++ source file,
+ *        the layer sizes are compile time constants, the buffers are
+ *        static and the weights are embedded or mmapped from a file
+ */
+
+#include <stdio.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "xnet.h"
+#include "parse-option.h"
+
+// Shared by all the generated files, the sizes are template arguments
+// so every layer gets a fully specialized loop nest
+static const char *kRuntime = R"(
+// Same values as ActivationType of xnet
+enum { kNone = 0, kRelu = 1, kSigmoid = 2, kTanh = 3 };
+
+template <int A>
+static inline float Activate(float x) {
+    if (A == kRelu) return x > 0 ? x : 0;
+    if (A == kSigmoid) return 1.0f / (1.0f + expf(-x));
+    if (A == kTanh) return tanhf(x);
+    return x;
+}
+
+template <int N, int A>
+static inline void Activation(const float *x, int rows, float *y) {
+    for (int i = 0; i < rows * N; i++) y[i] = Activate<A>(x[i]);
+}
+
+// y[rows][N] = act(x[rows][K] * w[K][N] + b), w is transposed so the
+// inner loop is a plain axpy over N which -O3 vectorizes
+template <int N, int K, int A>
+static inline void Dense(const float *x, int rows, const float *w,
+        const float *b, float *y) {
+    for (int i = 0; i < rows; i++) {
+        const float *x_row = x + i * K;
+        float *y_row = y + i * N;
+        for (int j = 0; j < N; j++) y_row[j] = b != nullptr ? b[j] : 0;
+        for (int p = 0; p < K; p++) {
+            const float *w_row = w + p * N;
+            float x_p = x_row[p];
+            for (int j = 0; j < N; j++) y_row[j] += x_p * w_row[j];
+        }
+        for (int j = 0; j < N; j++) y_row[j] = Activate<A>(y_row[j]);
+    }
+}
+
+// Quantize x to uint8 with one scale as xnet QuantizeData
+static inline void QuantizeInput(const float *x, int n, uint8_t *q,
+        float *scale, int *zero_point) {
+    float min = 0, max = 0;
+    for (int i = 0; i < n; i++) {
+        if (x[i] < min) min = x[i];
+        if (x[i] > max) max = x[i];
+    }
+    double scale_double = (max - min) / 255.0;
+    double initial_zero_point = -min / scale_double;
+    uint8_t nudged = initial_zero_point < 0 ? 0 :
+        initial_zero_point > 255 ? 255 :
+        static_cast<uint8_t>(round(initial_zero_point));
+    *scale = scale_double;
+    *zero_point = nudged;
+    for (int i = 0; i < n; i++) {
+        float point = nudged + x[i] / *scale;
+        point = point < 0 ? 0 : (point > 255 ? 255 : point);
+        q[i] = static_cast<uint8_t>(roundf(point));
+    }
+}
+
+// Same as Dense on uint8 x and w, q is a scratch of rows * K
+template <int N, int K, int A>
+static inline void QuantizeDense(const float *x, int rows, const uint8_t *w,
+        float w_scale, int w_zero_point, const float *b, uint8_t *q,
+        float *y) {
+    float x_scale;
+    int x_zero_point;
+    QuantizeInput(x, rows * K, q, &x_scale, &x_zero_point);
+    float scale = x_scale * w_scale;
+    for (int i = 0; i < rows; i++) {
+        const uint8_t *q_row = q + i * K;
+        float *y_row = y + i * N;
+        int32_t acc[N] = { 0 };
+        for (int p = 0; p < K; p++) {
+            const uint8_t *w_row = w + p * N;
+            int32_t x_p = q_row[p] - x_zero_point;
+            for (int j = 0; j < N; j++) acc[j] += x_p * (w_row[j] - w_zero_point);
+        }
+        for (int j = 0; j < N; j++) {
+            y_row[j] = Activate<A>(scale * acc[j] + (b != nullptr ? b[j] : 0));
+        }
+    }
+}
+
+template <int N>
+static inline void Softmax(const float *x, int rows, float *y) {
+    for (int i = 0; i < rows; i++) {
+        const float *x_row = x + i * N;
+        float *y_row = y + i * N;
+        float max = x_row[0], sum = 0;
+        for (int j = 1; j < N; j++) max = x_row[j] > max ? x_row[j] : max;
+        for (int j = 0; j < N; j++) sum += y_row[j] = expf(x_row[j] - max);
+        for (int j = 0; j < N; j++) y_row[j] /= sum;
+    }
+}
+)";
+
+static const char *kMmapInit = R"(
+bool Init(const char *weight_file) {
+    int fd = open(weight_file, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size != kWeightBytes) {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, kWeightBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+    weights = static_cast<const char *>(data);
+    return true;
+}
+)";
+
+static std::string FloatLiteral(float x) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9g", x);
+    std::string s = buf;
+    // 1f is not a float literal
+    if (s.find_first_of(".e") == std::string::npos) s += ".";
+    return s + "f";
+}
+
+struct Layer {
+    NodeProto_NodeType type;
+    int num_out, num_in;
+    ActivationType activation; // fused activation
+    std::string weight, bias; // variable names
+    float w_scale;
+    int w_zero_point;
+};
+
+// Emit a weight array, embedded as an initializer or as a pointer into
+// the mmapped weight file
+class WeightWriter {
+public:
+    WeightWriter(std::ostream *os, std::ofstream *weight_file):
+        os_(os), weight_file_(weight_file), offset_(0) {}
+    template <class DType>
+    void Write(const std::string &ctype, const std::string &name,
+               const DType *data, int n) {
+        if (weight_file_ == nullptr) {
+            *os_ << "alignas(64) static const " << ctype << " " << name
+                 << "[" << n << "] = {";
+            for (int i = 0; i < n; i++) {
+                if (i % 8 == 0) *os_ << "\n   ";
+                *os_ << " " << Literal(data[i]) << ",";
+            }
+            *os_ << "\n};\n";
+        } else {
+            // Align every array to 64 bytes in the file
+            while (offset_ % 64 != 0) {
+                weight_file_->put(0);
+                offset_++;
+            }
+            *os_ << "#define " << name << " reinterpret_cast<const " << ctype
+                 << " *>(weights + " << offset_ << ")\n";
+            weight_file_->write(reinterpret_cast<const char *>(data),
+                                sizeof(DType) * n);
+            offset_ += sizeof(DType) * n;
+        }
+    }
+    int64_t Offset() const { return offset_; }
+private:
+    static std::string Literal(float x) { return FloatLiteral(x); }
+    static std::string Literal(uint8_t x) { return std::to_string(x); }
+    std::ostream *os_;
+    std::ofstream *weight_file_;
+    int64_t offset_;
+};
+
+template <class DType>
+static void Transpose(const Matrix<DType> &in, Matrix<DType> *out) {
+    out->Resize(in.NumCols(), in.NumRows());
+    for (int i = 0; i < in.NumRows(); i++) {
+        for (int j = 0; j < in.NumCols(); j++) {
+            (*out)(j, i) = in(i, j);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Compile a net to a standalone c++ source file\n"
+                        "Usage: xnet-compile [options] net_file cc_file\n";
+    ParseOptions option(usage);
+    int max_batch = 16;
+    std::string name_space = "xnet_model", weight_file = "";
+    option.Register("max-batch", &max_batch,
+        "rows of the static buffers, larger batch runs in chunks");
+    option.Register("namespace", &name_space,
+        "namespace of the generated code");
+    option.Register("weight-file", &weight_file,
+        "write the weights to the file and mmap it in Init(), "
+        "embed them in the source if empty");
+    option.Read(argc, argv);
+    if (option.NumArgs() != 2) {
+        option.PrintUsage();
+        exit(1);
+    }
+    std::string net_file = option.GetArg(1), cc_file = option.GetArg(2);
+    CHECK(max_batch > 0);
+
+    // Loaded by XNet, so the default passes drop the Identity nodes and
+    // fold Scale/BatchNorm into the fully connect before them(eg: the
+    // Dropout and BatchNormalization layers of a converted keras model)
+    NetProto net_proto;
+    {
+        XNet net(net_file);
+        net.ToProto(&net_proto);
+    }
+
+    std::ofstream weight_os;
+    if (weight_file != "") {
+        weight_os.open(weight_file, std::ios::out | std::ios::binary);
+        if (!weight_os) ERROR("failed to write %s", weight_file.c_str());
+    }
+    std::ostringstream weights;
+    WeightWriter writer(&weights, weight_file != "" ? &weight_os : nullptr);
+
+    // Layers, activations after (quantize) fully connect are fused
+    std::vector<Layer> layers;
+    int dim = 0, input_dim = 0;
+    for (int i = 0; i < net_proto.nodes_size(); i++) {
+        const NodeProto &node = net_proto.nodes(i);
+        Layer layer;
+        layer.type = node.node_type();
+        layer.activation = ACTIVATION_NONE;
+        std::string id = std::to_string(layers.size());
+        if (node.has_output_head() && 
+            node.output_head().mode() != OutputHeadParameter::NONE) {
+            ERROR("node %d has an output head, it is not supported", i);
+        }
+        switch (node.node_type()) {
+            case NodeProto::FULLY_CONNECT: {
+                const FullyConnectParameter &param = node.fully_connect_param();
+                Matrix<float> weight;
+                weight.FromProto(param.weight());
+                layer.num_out = weight.NumRows();
+                layer.num_in = weight.NumCols();
+                layer.weight = "w" + id;
+                Matrix<float> transpose;
+                Transpose(weight, &transpose);
+                writer.Write("float", layer.weight, transpose.Data(),
+                             transpose.Size());
+                if (param.has_bias()) {
+                    Vector<float> bias;
+                    bias.FromProto(param.bias());
+                    layer.bias = "b" + id;
+                    writer.Write("float", layer.bias, bias.Data(), bias.Size());
+                }
+                break;
+            }
+            case NodeProto::QUANTIZE_FULLY_CONNECT: {
+                const QuantizeFullyConnectParameter &param =
+                    node.quantize_fully_connect_param();
+                Matrix<uint8_t> weight;
+                weight.FromProto(param.weight().tensor());
+                layer.num_out = weight.NumRows();
+                layer.num_in = weight.NumCols();
+                layer.w_scale = param.weight().scale();
+                layer.w_zero_point = param.weight().zero_point();
+                layer.weight = "w" + id;
+                Matrix<uint8_t> transpose;
+                Transpose(weight, &transpose);
+                writer.Write("uint8_t", layer.weight, transpose.Data(),
+                             transpose.Size());
+                if (param.has_bias()) {
+                    Vector<float> bias;
+                    bias.FromProto(param.bias());
+                    layer.bias = "b" + id;
+                    writer.Write("float", layer.bias, bias.Data(), bias.Size());
+                }
+                break;
+            }
+            case NodeProto::RELU:
+            case NodeProto::SIGMOID:
+            case NodeProto::TANH: {
+                ActivationType act = Node::NodeTypeToActivation(node.node_type());
+                if (!layers.empty() && 
+                    layers.back().activation == ACTIVATION_NONE &&
+                    (layers.back().type == NodeProto::FULLY_CONNECT ||
+                     layers.back().type == NodeProto::QUANTIZE_FULLY_CONNECT)) {
+                    layers.back().activation = act;
+                    continue;
+                }
+                layer.activation = act;
+                layer.num_in = layer.num_out = dim;
+                break;
+            }
+            case NodeProto::SOFTMAX:
+                layer.num_in = layer.num_out = dim;
+                break;
+            default:
+                ERROR("unsupported node type %d", node.node_type());
+        }
+        if (layers.empty()) input_dim = layer.num_in;
+        if (layer.num_in == 0 || (dim != 0 && layer.num_in != dim)) {
+            ERROR("node %d input dim %d does not match %d", i,
+                  layer.num_in, dim);
+        }
+        dim = layer.num_out;
+        layers.push_back(layer);
+    }
+    if (layers.empty()) ERROR("no node in %s", net_file.c_str());
+
+    std::ofstream os(cc_file);
+    if (!os) ERROR("failed to write %s", cc_file.c_str());
+    os << "// Generated by xnet-compile from " << net_file << ", do not edit\n"
+       << "// Build with -O3(and -march=native for the host instruction set)\n"
+       << "//\n"
+       << "// namespace " << name_space << " {\n";
+    if (weight_file != "") {
+        os << "// // mmap the weight file, call it once before Forward\n"
+           << "// bool Init(const char *weight_file);\n";
+    }
+    os << "// // in is rows x kInputDim, out is rows x kOutputDim, not thread\n"
+       << "// // safe, the buffers are static\n"
+       << "// void Forward(const float *in, int rows, float *out);\n"
+       << "// }\n\n"
+       << "#include <math.h>\n#include <stdint.h>\n";
+    if (weight_file != "") {
+        os << "#include <fcntl.h>\n#include <sys/mman.h>\n"
+           << "#include <sys/stat.h>\n#include <unistd.h>\n";
+    }
+    os << "\nnamespace " << name_space << " {\n\n"
+       << "constexpr int kMaxBatch = " << max_batch << ";\n"
+       << "constexpr int kInputDim = " << input_dim << ";\n"
+       << "constexpr int kOutputDim = " << dim << ";\n"
+       << kRuntime << "\n";
+    if (weight_file != "") {
+        os << "constexpr long kWeightBytes = " << writer.Offset() << ";\n"
+           << "static const char *weights = nullptr;\n";
+    }
+    os << weights.str() << "\n";
+    if (weight_file != "") os << kMmapInit << "\n";
+
+    // Ping-pong buffers, the last layer writes out
+    int max_dim = 0, max_quantize_dim = 0;
+    for (int i = 0; i < layers.size(); i++) {
+        max_dim = std::max(max_dim, layers[i].num_out);
+        if (layers[i].type == NodeProto::QUANTIZE_FULLY_CONNECT) {
+            max_quantize_dim = std::max(max_quantize_dim, layers[i].num_in);
+        }
+    }
+    os << "alignas(64) static float buf[2][kMaxBatch * " << max_dim << "];\n";
+    if (max_quantize_dim > 0) {
+        os << "alignas(64) static uint8_t quantize_buf[kMaxBatch * "
+           << max_quantize_dim << "];\n";
+    }
+    os << "\nvoid Forward(const float *in, int rows, float *out) {\n"
+       << "    for (int i = 0; i < rows; i += kMaxBatch) {\n"
+       << "        int n = rows - i < kMaxBatch ? rows - i : kMaxBatch;\n";
+    for (int i = 0; i < layers.size(); i++) {
+        const Layer &layer = layers[i];
+        std::string x = i == 0 ? "in + i * kInputDim" :
+                                 "buf[" + std::to_string((i - 1) % 2) + "]";
+        std::string y = i + 1 == layers.size() ? "out + i * kOutputDim" :
+                                 "buf[" + std::to_string(i % 2) + "]";
+        std::string bias = layer.bias.empty() ? "nullptr" : layer.bias;
+        os << "        ";
+        switch (layer.type) {
+            case NodeProto::FULLY_CONNECT:
+                os << "Dense<" << layer.num_out << ", " << layer.num_in << ", "
+                   << layer.activation << ">(" << x << ", n, " << layer.weight
+                   << ", " << bias << ", " << y << ");\n";
+                break;
+            case NodeProto::QUANTIZE_FULLY_CONNECT:
+                os << "QuantizeDense<" << layer.num_out << ", "
+                   << layer.num_in << ", " << layer.activation << ">(" << x
+                   << ", n, " << layer.weight << ", " 
+                   << FloatLiteral(layer.w_scale) << ", "
+                   << layer.w_zero_point << ", " << bias
+                   << ", quantize_buf, " << y << ");\n";
+                break;
+            case NodeProto::SOFTMAX:
+                os << "Softmax<" << layer.num_out << ">(" << x << ", n, "
+                   << y << ");\n";
+                break;
+            default:
+                os << "Activation<" << layer.num_out << ", "
+                   << layer.activation << ">(" << x << ", n, " << y << ");\n";
+        }
+    }
+    os << "    }\n}\n\n} // namespace " << name_space << "\n";
+    LOG("compiled %d layers to %s", static_cast<int>(layers.size()),
+        cc_file.c_str());
+    return 0;
+}
@@ -0,0 +1,289 @@
+// Created on 2026-10-19
+// Author: Binbin Zhang
+// About: bulk offline inference, read, batch, forward and write run as
+//        pipeline stages on their own threads with bounded queues between
+//        them, so the disk and the cpu work overlap
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <thread>
+
+#include "xnet.h"
+#include "parse-option.h"
+#include "bounded-queue.h"
+#include "mnist-reader.h"
+
+// The input, a ubyte idx file(eg: mnist images, scaled by 1/255 like
+// ReadMnistImage) or rows of raw native float32
+class InputFile {
+public:
+    InputFile(): is_idx_(false), num_rows_(0), dim_(0), header_bytes_(0),
+                 file_bytes_(0), fd_(-1), map_(nullptr), fp_(nullptr) {}
+    ~InputFile() {
+        if (map_ != nullptr) munmap(const_cast<uint8_t *>(map_), file_bytes_);
+        if (fd_ >= 0) close(fd_);
+        if (fp_ != nullptr) fclose(fp_);
+    }
+    void Open(const std::string &file, const std::string &format,
+              int input_dim, bool use_mmap) {
+        fd_ = open(file.c_str(), O_RDONLY);
+        if (fd_ < 0) ERROR("file %s does not exist", file.c_str());
+        struct stat st;
+        CHECK(fstat(fd_, &st) == 0);
+        file_bytes_ = st.st_size;
+        if (format == "idx") {
+            // magic(0 0 0x08 ndims), then ndims big endian int32 dims
+            int32_t header[4] = { 0 };
+            if (pread(fd_, header, sizeof(header), 0) != sizeof(header)) {
+                ERROR("%s is too short for an idx file", file.c_str());
+            }
+            int magic = BigLittleSwap(header[0]);
+            if ((magic >> 8) != 0x08 || (magic & 0xff) != 3) {
+                ERROR("%s is not a 3 dim ubyte idx file, magic %x",
+                      file.c_str(), magic);
+            }
+            is_idx_ = true;
+            num_rows_ = BigLittleSwap(header[1]);
+            dim_ = BigLittleSwap(header[2]) * BigLittleSwap(header[3]);
+            header_bytes_ = sizeof(header);
+        } else if (format == "float") {
+            if (input_dim <= 0) ERROR("--input-dim is required for float");
+            dim_ = input_dim;
+            if (file_bytes_ % RowBytes() != 0) {
+                ERROR("%s has %lld bytes, not rows of %d floats(--input-dim)",
+                      file.c_str(), static_cast<long long>(file_bytes_),
+                      dim_);
+            }
+            num_rows_ = file_bytes_ / RowBytes();
+        } else {
+            ERROR("unknown input format %s", format.c_str());
+        }
+        if (header_bytes_ + num_rows_ * RowBytes() > file_bytes_) {
+            ERROR("%s is truncated", file.c_str());
+        }
+        // No rows to read, an empty output(mmap of 0 bytes fails)
+        if (num_rows_ == 0) return;
+        if (use_mmap) {
+            void *map = mmap(nullptr, file_bytes_, PROT_READ, MAP_PRIVATE,
+                             fd_, 0);
+            if (map == MAP_FAILED) ERROR("failed to mmap %s", file.c_str());
+            madvise(map, file_bytes_, MADV_SEQUENTIAL);
+            map_ = static_cast<const uint8_t *>(map);
+        } else {
+            fp_ = fdopen(dup(fd_), "rb");
+            CHECK(fp_ != nullptr);
+            fseek(fp_, header_bytes_, SEEK_SET);
+        }
+    }
+    int64_t NumRows() const { return num_rows_; }
+    int Dim() const { return dim_; }
+    int RowBytes() const { return is_idx_ ? dim_ : sizeof(float) * dim_; }
+    // Bytes of rows [row, row + num_rows), in the mapped file, or read in
+    // order to buffer. The pages of a mapped range are touched here, so
+    // the page faults(disk reads) happen on the read stage.
+    const uint8_t *Read(int64_t row, int num_rows,
+                        std::vector<uint8_t> *buffer) {
+        size_t bytes = static_cast<size_t>(num_rows) * RowBytes();
+        if (map_ != nullptr) {
+            const uint8_t *data = map_ + header_bytes_ + row * RowBytes();
+            volatile uint8_t sink = 0;
+            for (size_t i = 0; i < bytes; i += 4096) sink += data[i];
+            return data;
+        }
+        buffer->resize(bytes);
+        if (fread(buffer->data(), 1, bytes, fp_) != bytes) {
+            ERROR("failed to read row %lld", static_cast<long long>(row));
+        }
+        return buffer->data();
+    }
+    // Rows of bytes from Read to float
+    void ToFloat(const uint8_t *data, Matrix<float> *out) const {
+        if (is_idx_) {
+            for (int i = 0; i < out->Size(); i++) {
+                out->Data()[i] = static_cast<float>(data[i]) / 255;
+            }
+        } else {
+            memcpy(out->Data(), data, sizeof(float) * out->Size());
+        }
+    }
+private:
+    bool is_idx_;
+    int64_t num_rows_;
+    int dim_;
+    int64_t header_bytes_, file_bytes_;
+    int fd_;
+    const uint8_t *map_;
+    FILE *fp_;
+    DISALLOW_COPY_AND_ASSIGN(InputFile);
+};
+
+// A batch on its way through the pipeline, index keeps the output order
+struct Batch {
+    int64_t index, row;
+    int num_rows;
+    const uint8_t *raw;
+    std::vector<uint8_t> buffer; // raw bytes when not mapped
+    Matrix<float> in, out;
+};
+typedef std::unique_ptr<Batch> BatchPtr;
+
+// Seconds a stage spends on its own work, not waiting on the queues
+struct StageTimer {
+    StageTimer(): micros(0) {}
+    std::atomic<int64_t> micros;
+    void Add(const Timer &timer) {
+        micros += static_cast<int64_t>(timer.Elapsed());
+    }
+    double Seconds() const { return micros.load() / 1e6; }
+};
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Forward all the rows of an input file, and write the "
+        "outputs in order\n"
+        "eg: xnet-infer --format=idx --num-threads=2 net.proto images out.bin\n"
+        "The output is raw native float32 rows, or text with --text\n";
+    ParseOptions option(usage);
+    std::string format = "idx", tune_file = "";
+    int batch_size = 256, input_dim = 0, num_threads = 1, queue_size = 8;
+    bool use_mmap = true, text = false;
+    option.Register("format", &format, "input format, idx|float(raw "
+        "native float32 rows, needs --input-dim)");
+    option.Register("input-dim", &input_dim, "input dim of the float format");
+    option.Register("batch", &batch_size, "batch size for net forward");
+    option.Register("num-threads", &num_threads,
+        "forward threads, each one runs a replica of the net");
+    option.Register("queue-size", &queue_size,
+        "batches a stage can run ahead of the next one");
+    option.Register("mmap", &use_mmap, "mmap the input, or read it");
+    option.Register("text", &text, "write the outputs as text");
+    option.Register("tune-file", &tune_file,
+        "use the kernels tuned by xnet-tune");
+    option.Read(argc, argv);
+    if (option.NumArgs() != 3 || batch_size <= 0 || num_threads <= 0 ||
+        queue_size <= 0) {
+        option.PrintUsage();
+        exit(1);
+    }
+    std::string net_file = option.GetArg(1), input_file = option.GetArg(2),
+                output_file = option.GetArg(3);
+
+    InputFile input;
+    input.Open(input_file, format, input_dim, use_mmap);
+    XNet net(net_file);
+    if (tune_file != "") {
+        TuneTable table;
+        table.Read(tune_file);
+        net.SetTuneTable(table);
+    }
+    // The replicas forward at the same time, blas is process wide
+    if (num_threads > 1) SetBlasNumThreads(1);
+    int output_dim = net.OutputDim(input.Dim());
+    FILE *output = fopen(output_file.c_str(), text ? "w" : "wb");
+    if (output == nullptr) ERROR("failed to write %s", output_file.c_str());
+
+    BoundedQueue<BatchPtr> read_queue(queue_size), batch_queue(queue_size),
+                           write_queue(queue_size);
+    StageTimer read_timer, batch_timer, forward_timer, write_timer;
+    Timer total_timer;
+
+    std::thread read_thread([&]() {
+        for (int64_t row = 0, index = 0; row < input.NumRows();
+             row += batch_size, index++) {
+            Timer timer;
+            BatchPtr batch(new Batch());
+            batch->index = index;
+            batch->row = row;
+            batch->num_rows = static_cast<int>(
+                std::min<int64_t>(batch_size, input.NumRows() - row));
+            batch->raw = input.Read(row, batch->num_rows, &batch->buffer);
+            read_timer.Add(timer);
+            read_queue.Push(std::move(batch));
+        }
+        read_queue.Close();
+    });
+
+    std::thread batch_thread([&]() {
+        BatchPtr batch;
+        while (read_queue.Pop(&batch)) {
+            Timer timer;
+            batch->in.Resize(batch->num_rows, input.Dim());
+            input.ToFloat(batch->raw, &batch->in);
+            std::vector<uint8_t>().swap(batch->buffer);
+            batch_timer.Add(timer);
+            batch_queue.Push(std::move(batch));
+        }
+        batch_queue.Close();
+    });
+
+    // Every forward thread has a replica, the last one closes the queue
+    std::vector<std::unique_ptr<XNet> > replicas(num_threads);
+    std::vector<std::thread> forward_threads;
+    std::atomic<int> num_running(num_threads);
+    for (int t = 0; t < num_threads; t++) {
+        replicas[t].reset(new XNet());
+        net.Copy(replicas[t].get());
+        forward_threads.push_back(std::thread([&, t]() {
+            BatchPtr batch;
+            while (batch_queue.Pop(&batch)) {
+                Timer timer;
+                replicas[t]->Forward(batch->in, &batch->out);
+                forward_timer.Add(timer);
+                write_queue.Push(std::move(batch));
+            }
+            if (--num_running == 0) write_queue.Close();
+        }));
+    }
+
+    // Batches may finish out of order with more forward threads
+    std::thread write_thread([&]() {
+        std::map<int64_t, BatchPtr> pending;
+        int64_t next = 0;
+        BatchPtr batch;
+        while (write_queue.Pop(&batch)) {
+            pending[batch->index] = std::move(batch);
+            Timer timer;
+            while (!pending.empty() && pending.begin()->first == next) {
+                const Matrix<float> &out = pending.begin()->second->out;
+                if (text) {
+                    for (int i = 0; i < out.NumRows(); i++) {
+                        for (int j = 0; j < out.NumCols(); j++) {
+                            fprintf(output, j == 0 ? "%g" : " %g", out(i, j));
+                        }
+                        fprintf(output, "\n");
+                    }
+                } else if (fwrite(out.Data(), sizeof(float), out.Size(),
+                                  output) != out.Size()) {
+                    ERROR("failed to write %s", output_file.c_str());
+                }
+                pending.erase(pending.begin());
+                next++;
+            }
+            write_timer.Add(timer);
+        }
+        CHECK(pending.empty());
+    });
+
+    read_thread.join();
+    batch_thread.join();
+    for (int t = 0; t < num_threads; t++) forward_threads[t].join();
+    write_thread.join();
+    fclose(output);
+
+    double seconds = total_timer.Elapsed() / 1e6;
+    printf("rows %lld input dim %d output dim %d\n",
+           static_cast<long long>(input.NumRows()), input.Dim(), output_dim);
+    printf("total %.3fs, %.1f rows/s, %.2f MB/s input\n", seconds,
+           input.NumRows() / seconds,
+           input.NumRows() * input.RowBytes() / seconds / 1e6);
+    printf("busy read %.3fs, batch %.3fs, forward %.3fs(%d threads), "
+           "write %.3fs\n", read_timer.Seconds(), batch_timer.Seconds(),
+           forward_timer.Seconds(), num_threads, write_timer.Seconds());
+    return 0;
+}
@@ -0,0 +1,371 @@
+// Created on 2026-10-19
+// Author: Binbin Zhang
+// About: load generator, drives a net with requests of random batch size
+//        at a fixed rate(open loop) or back to back(closed loop) from
+//        several threads, and reports the throughput and the latency
+//        percentiles and histogram
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include "xnet.h"
+#include "parse-option.h"
+#include "bounded-queue.h"
+#include "mnist-reader.h"
+
+// Log linear histogram of microseconds, values below 64 are exact, above
+// them every power of 2 is split into 32 buckets, so a percentile is
+// within 1/32 of the true value
+class LatencyHistogram {
+public:
+    LatencyHistogram(): counts_(kNumBuckets, 0), num_(0), sum_(0), max_(0) {}
+    void Add(double micros) {
+        int64_t v = std::max<int64_t>(0, static_cast<int64_t>(micros));
+        counts_[Bucket(v)]++;
+        num_++;
+        sum_ += micros;
+        max_ = std::max(max_, micros);
+    }
+    void Merge(const LatencyHistogram &other) {
+        for (int i = 0; i < kNumBuckets; i++) counts_[i] += other.counts_[i];
+        num_ += other.num_;
+        sum_ += other.sum_;
+        max_ = std::max(max_, other.max_);
+    }
+    int64_t Num() const { return num_; }
+    double Mean() const { return num_ > 0 ? sum_ / num_ : 0; }
+    double Max() const { return max_; }
+    // The upper bound of the bucket of the q(0~1) quantile
+    double Percentile(double q) const {
+        if (num_ == 0) return 0;
+        int64_t rank = std::max<int64_t>(1,
+            static_cast<int64_t>(q * num_ + 0.5)), sum = 0;
+        for (int i = 0; i < kNumBuckets; i++) {
+            sum += counts_[i];
+            if (sum >= rank) return std::min<double>(UpperBound(i), max_);
+        }
+        return max_;
+    }
+    // Counts of power of 2 ranges [2^i, 2^(i+1)) us, 0 is [0, 2)
+    std::vector<int64_t> Log2Counts() const {
+        std::vector<int64_t> log2_counts;
+        for (int i = 0; i < kNumBuckets; i++) {
+            if (counts_[i] == 0) continue;
+            int64_t lower = LowerBound(i);
+            int e = lower < 2 ? 0 : 63 - __builtin_clzll(lower);
+            if (log2_counts.size() <= e) log2_counts.resize(e + 1, 0);
+            log2_counts[e] += counts_[i];
+        }
+        return log2_counts;
+    }
+private:
+    static const int kSubBits = 5, kSub = 1 << kSubBits,
+                     kNumBuckets = 2 * kSub + (40 - kSubBits) * kSub;
+    static int Bucket(int64_t v) {
+        if (v < 2 * kSub) return v;
+        int e = 63 - __builtin_clzll(v);
+        if (e >= 40) return kNumBuckets - 1;
+        return 2 * kSub + (e - kSubBits - 1) * kSub +
+               ((v >> (e - kSubBits)) & (kSub - 1));
+    }
+    static int64_t LowerBound(int i) {
+        if (i < 2 * kSub) return i;
+        int e = (i - 2 * kSub) / kSub + kSubBits + 1, sub = i % kSub;
+        return static_cast<int64_t>(kSub + sub) << (e - kSubBits);
+    }
+    static int64_t UpperBound(int i) {
+        return i + 1 < kNumBuckets ? LowerBound(i + 1) : LowerBound(i);
+    }
+    std::vector<int64_t> counts_;
+    int64_t num_;
+    double sum_, max_;
+};
+
+struct Request {
+    int64_t index;
+    int batch_size;
+    double scheduled; // micros since start
+};
+
+// Latency from the scheduled time, so the time waiting in the queue is
+// counted, and service is the forward only
+struct WorkerStats {
+    WorkerStats(): num_rows(0) {}
+    LatencyHistogram latency, service;
+    std::map<int, LatencyHistogram> batch_latency;
+    int64_t num_rows;
+};
+
+// "1:70,4:20,16:10" to batch sizes and weights
+static void ParseBatchSizes(const std::string &spec, std::vector<int> *sizes,
+        std::vector<double> *weights) {
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        size_t pos = item.find(':');
+        int size = atoi(item.substr(0, pos).c_str());
+        double weight = pos == std::string::npos ? 1 :
+                        atof(item.substr(pos + 1).c_str());
+        if (size <= 0 || weight <= 0) {
+            ERROR("bad batch size %s in %s", item.c_str(), spec.c_str());
+        }
+        sizes->push_back(size);
+        weights->push_back(weight);
+    }
+    if (sizes->empty()) ERROR("no batch size in %s", spec.c_str());
+}
+
+static void PrintRow(const char *name, const LatencyHistogram &hist) {
+    printf("%-12s %10lld %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n", name,
+           static_cast<long long>(hist.Num()), hist.Mean() / 1e3,
+           hist.Percentile(0.5) / 1e3, hist.Percentile(0.9) / 1e3,
+           hist.Percentile(0.99) / 1e3, hist.Percentile(0.999) / 1e3,
+           hist.Max() / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Drive a net with requests from several threads, and "
+        "report the throughput and the latency percentiles\n"
+        "eg: xnet-load --rate=500 --batch-sizes=1:70,4:20,16:10 "
+        "--num-threads=2 --input-dim=784 net.proto\n"
+        "    xnet-load --rate=0 --format=idx --input=images net.proto\n";
+    ParseOptions option(usage);
+    std::string input_file = "", format = "idx", batch_spec = "1",
+                tune_file = "";
+    int input_dim = 0, num_threads = 1, queue_size = 1024, seed = 777;
+    int num_synthetic_rows = 1024;
+    float rate = 0, duration = 10, warmup = 1, cache_mb = 0;
+    bool poisson = true;
+    option.Register("rate", &rate, "requests per second of all the threads, "
+        "0 for closed loop, every thread sends the next request when the "
+        "last one is done");
+    option.Register("poisson", &poisson, "poisson arrivals at the rate, "
+        "else evenly spaced");
+    option.Register("batch-sizes", &batch_spec, "batch size distribution "
+        "of the requests, size:weight comma separated, eg: 1:70,4:20,16:10");
+    option.Register("num-threads", &num_threads,
+        "forward threads, each one runs a replica of the net");
+    option.Register("duration", &duration, "seconds to send requests");
+    option.Register("warmup", &warmup, "seconds of requests at the start "
+        "which are not counted");
+    option.Register("queue-size", &queue_size, "requests which can wait "
+        "for a thread at the rate, the sender blocks then, their latency "
+        "still counts from the scheduled time");
+    option.Register("input", &input_file, "feature file of the input rows, "
+        "synthetic uniform [0, 1) rows of --input-dim if empty");
+    option.Register("format", &format, "format of --input, idx(mnist "
+        "images) or float(raw native float32 rows, needs --input-dim)");
+    option.Register("input-dim", &input_dim, "input dim of the synthetic "
+        "rows or the float format");
+    option.Register("num-synthetic-rows", &num_synthetic_rows, "distinct "
+        "synthetic rows, the requests repeat them");
+    option.Register("cache-mb", &cache_mb, "MB of a result cache shared "
+        "by the threads, the rows seen before are not forwarded, 0 for no "
+        "cache");
+    option.Register("seed", &seed, "seed of the inputs, batch sizes and "
+        "arrivals");
+    option.Register("tune-file", &tune_file,
+        "use the kernels tuned by xnet-tune");
+    option.Read(argc, argv);
+    if (option.NumArgs() != 1 || num_threads <= 0 || queue_size <= 0 ||
+        rate < 0 || duration <= 0 || warmup < 0 || warmup >= duration) {
+        option.PrintUsage();
+        exit(1);
+    }
+    std::vector<int> batch_sizes;
+    std::vector<double> batch_weights;
+    ParseBatchSizes(batch_spec, &batch_sizes, &batch_weights);
+    int max_batch = *std::max_element(batch_sizes.begin(), batch_sizes.end());
+
+    //// input rows, requests take rows of it in turn
+    std::mt19937 generator(seed);
+    Matrix<float> rows;
+    if (input_file == "") {
+        if (input_dim <= 0) ERROR("--input-dim is required without --input");
+        std::uniform_real_distribution<float> uniform(0, 1);
+        rows.Resize(std::max(num_synthetic_rows, max_batch), input_dim);
+        for (int i = 0; i < rows.Size(); i++) {
+            rows.Data()[i] = uniform(generator);
+        }
+    } else if (format == "idx") {
+        ReadMnistImage(input_file, &rows);
+    } else if (format == "float") {
+        if (input_dim <= 0) ERROR("--input-dim is required for float");
+        FILE *fp = fopen(input_file.c_str(), "rb");
+        if (fp == nullptr) ERROR("file %s does not exist", input_file.c_str());
+        fseek(fp, 0, SEEK_END);
+        int num_rows = ftell(fp) / (sizeof(float) * input_dim);
+        fseek(fp, 0, SEEK_SET);
+        rows.Resize(num_rows, input_dim);
+        CHECK(fread(rows.Data(), sizeof(float), rows.Size(), fp) ==
+              rows.Size());
+        fclose(fp);
+    } else {
+        ERROR("unknown input format %s", format.c_str());
+    }
+    if (rows.NumRows() < max_batch) {
+        ERROR("%d input rows, less than the batch size %d", rows.NumRows(),
+              max_batch);
+    }
+
+    XNet net(option.GetArg(1));
+    if (tune_file != "") {
+        TuneTable table;
+        table.Read(tune_file);
+        net.SetTuneTable(table);
+    }
+    // The replicas forward at the same time, blas is process wide
+    if (num_threads > 1) SetBlasNumThreads(1);
+    std::unique_ptr<ResultCache> cache;
+    if (cache_mb > 0) {
+        cache.reset(new ResultCache(static_cast<int64_t>(cache_mb * 1e6)));
+    }
+    std::vector<std::unique_ptr<XNet> > replicas(num_threads);
+    for (int t = 0; t < num_threads; t++) {
+        replicas[t].reset(new XNet());
+        net.Copy(replicas[t].get());
+        replicas[t]->SetResultCache(cache.get());
+    }
+
+    const double warmup_micros = warmup * 1e6, end_micros = duration * 1e6;
+    std::vector<WorkerStats> stats(num_threads);
+    BoundedQueue<Request> queue(queue_size);
+    Timer clock;
+
+    // A request of batch b forwards the rows after the ones of the last
+    // request, wrapping around
+    auto serve = [&](int t, const Request &request, Matrix<float> *in,
+                     Matrix<float> *out) {
+        int64_t row = request.index * max_batch %
+                      (rows.NumRows() - request.batch_size + 1);
+        in->Resize(request.batch_size, rows.NumCols());
+        for (int i = 0; i < request.batch_size; i++) {
+            memcpy(in->Data() + i * in->Stride(),
+                   rows.Data() + (row + i) * rows.Stride(),
+                   sizeof(float) * rows.NumCols());
+        }
+        double start = clock.Elapsed();
+        replicas[t]->Forward(*in, out);
+        double end = clock.Elapsed();
+        if (request.scheduled < warmup_micros) return;
+        WorkerStats &s = stats[t];
+        s.latency.Add(end - request.scheduled);
+        s.service.Add(end - start);
+        s.batch_latency[request.batch_size].Add(end - request.scheduled);
+        s.num_rows += request.batch_size;
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            Matrix<float> in, out;
+            Request request;
+            if (rate > 0) {
+                while (queue.Pop(&request)) serve(t, request, &in, &out);
+                return;
+            }
+            // Closed loop, scheduled when the last one is done
+            std::mt19937 thread_generator(seed + t);
+            std::discrete_distribution<int> batch(batch_weights.begin(),
+                                                  batch_weights.end());
+            for (int64_t i = 0; ; i++) {
+                request.scheduled = clock.Elapsed();
+                if (request.scheduled >= end_micros) break;
+                request.index = i * num_threads + t;
+                request.batch_size = batch_sizes[batch(thread_generator)];
+                serve(t, request, &in, &out);
+            }
+        }));
+    }
+
+    // Open loop, the arrivals do not wait for the responses, so a slow
+    // response delays no later request and shows in the tail
+    if (rate > 0) {
+        std::discrete_distribution<int> batch(batch_weights.begin(),
+                                              batch_weights.end());
+        std::exponential_distribution<double> interval(rate / 1e6);
+        double scheduled = 0;
+        for (int64_t i = 0; scheduled < end_micros; i++) {
+            // Sleep overshoots by tens of micros, which would count as
+            // latency, so sleep short of the time and yield the rest
+            double wait = scheduled - clock.Elapsed();
+            if (wait > 200) {
+                std::this_thread::sleep_for(std::chrono::microseconds(
+                    static_cast<int64_t>(wait) - 100));
+            }
+            while (clock.Elapsed() < scheduled) std::this_thread::yield();
+            Request request;
+            request.index = i;
+            request.batch_size = batch_sizes[batch(generator)];
+            request.scheduled = scheduled;
+            queue.Push(request);
+            scheduled += poisson ? interval(generator) : 1e6 / rate;
+        }
+        queue.Close();
+    }
+    for (int t = 0; t < num_threads; t++) threads[t].join();
+    // The closed loop runs to the end of its last request
+    double seconds = (std::max(clock.Elapsed(), end_micros) -
+                      warmup_micros) / 1e6;
+
+    WorkerStats total;
+    for (int t = 0; t < num_threads; t++) {
+        total.latency.Merge(stats[t].latency);
+        total.service.Merge(stats[t].service);
+        for (auto &it : stats[t].batch_latency) {
+            total.batch_latency[it.first].Merge(it.second);
+        }
+        total.num_rows += stats[t].num_rows;
+    }
+
+    printf("threads %d, batch sizes %s, ", num_threads, batch_spec.c_str());
+    if (rate > 0) {
+        printf("open loop %.1f requests/s(%s)\n", rate,
+               poisson ? "poisson" : "even");
+    } else {
+        printf("closed loop\n");
+    }
+    printf("requests %lld, rows %lld in %.2fs, %.1f requests/s, %.1f "
+           "rows/s\n", static_cast<long long>(total.latency.Num()),
+           static_cast<long long>(total.num_rows), seconds,
+           total.latency.Num() / seconds, total.num_rows / seconds);
+    printf("%-12s %10s %9s %9s %9s %9s %9s %9s\n", "(ms)", "requests",
+           "mean", "p50", "p90", "p99", "p999", "max");
+    PrintRow("latency", total.latency);
+    PrintRow("service", total.service);
+    for (auto &it : total.batch_latency) {
+        char name[32];
+        snprintf(name, sizeof(name), "batch %d", it.first);
+        PrintRow(name, it.second);
+    }
+    if (cache != nullptr) {
+        int64_t hits = cache->Hits(), misses = cache->Misses();
+        printf("cache hits %lld, misses %lld, hit rate %.2f%%, %lld "
+               "entries, %.2f/%.2f MB, %lld evictions\n",
+               static_cast<long long>(hits), static_cast<long long>(misses),
+               100.0 * hits / std::max<int64_t>(1, hits + misses),
+               static_cast<long long>(cache->NumEntries()),
+               cache->Bytes() / 1e6, cache->MaxBytes() / 1e6,
+               static_cast<long long>(cache->Evictions()));
+    }
+    printf("latency histogram\n");
+    std::vector<int64_t> counts = total.latency.Log2Counts();
+    int64_t max_count = counts.empty() ? 1 :
+                        *std::max_element(counts.begin(), counts.end());
+    for (int i = 0; i < counts.size(); i++) {
+        if (counts[i] == 0) continue;
+        double lower = i == 0 ? 0 : (1LL << i) / 1e3,
+               upper = (2LL << i) / 1e3;
+        printf("[%9.3f, %9.3f) ms %10lld %6.2f%% %s\n", lower, upper,
+               static_cast<long long>(counts[i]),
+               100.0 * counts[i] / total.latency.Num(),
+               std::string(40 * counts[i] / max_count, '#').c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,166 @@
+// Created on 2026-10-19
+// Author: Binbin Zhang
+// About: choose which layers to quantize under an accuracy budget.
+//   1. profile the float net and the fully quantized net, the per layer
+//      speed gain of quantization is the time difference of the layer
+//   2. quantize one layer at a time, the accuracy drop is measured on a
+//      labeled mnist format dataset
+//   3. greedily pick layers by gain/drop until the budget is used, then
+//      verify the combined net, and back off while it is over budget
+
+#include <algorithm>
+#include <iostream>
+
+#include "xnet.h"
+#include "parse-option.h"
+#include "mnist-reader.h"
+
+struct LayerInfo {
+    int id;
+    double float_us, quantize_us; // avg time per forward
+    double accuracy_drop;
+    double Gain() const { return float_us - quantize_us; }
+    double Ratio() const {
+        return Gain() / std::max(accuracy_drop, 1e-6);
+    }
+};
+
+static double Evaluate(XNet *net, const Matrix<float> &data,
+        const std::vector<int> &label, int batch, Profiler *profiler) {
+    net->SetProfiler(profiler);
+    int num_images = label.size(), num_correct = 0;
+    Matrix<float> out;
+    for (int i = 0; i < num_images; i += batch) {
+        int real_batch = i + batch < num_images ? batch : num_images - i;
+        Matrix<float> in = data.RowRange(i, real_batch);
+        net->Forward(in, &out);
+        for (int m = 0; m < out.NumRows(); m++) {
+            int max_idx = 0;
+            for (int n = 1; n < out.NumCols(); n++) {
+                if (out(m, n) > out(m, max_idx)) max_idx = n;
+            }
+            if (max_idx == label[i+m]) num_correct++;
+        }
+    }
+    net->SetProfiler(nullptr);
+    return static_cast<double>(num_correct) / num_images;
+}
+
+// Average time of every node per forward call
+static std::vector<double> NodeTimes(const Profiler &profiler, int num_nodes) {
+    std::vector<double> times(num_nodes, 0);
+    const std::map<int, Profiler::Stat> &stats = profiler.NodeStats();
+    for (auto it = stats.begin(); it != stats.end(); it++) {
+        times[it->first] = it->second.time_us / it->second.calls;
+    }
+    return times;
+}
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Choose a mixed float/int8 net with best speed under "
+        "an accuracy budget\n"
+        "eg: xnet-mixed-precision float.net images labels mixed.net\n";
+    ParseOptions option(usage);
+    int batch = 32;
+    float max_accuracy_loss = 0.005;
+    option.Register("batch", &batch, "batch size for net forward");
+    option.Register("max-accuracy-loss", &max_accuracy_loss,
+        "max absolute accuracy loss against the float net");
+    option.Read(argc, argv);
+    if (option.NumArgs() != 4) {
+        option.PrintUsage();
+        exit(1);
+    }
+    std::string float_net_file = option.GetArg(1),
+                image_file = option.GetArg(2),
+                label_file = option.GetArg(3),
+                mixed_net_file = option.GetArg(4);
+
+    XNet net(float_net_file), quantize_net, mixed_net;
+    std::vector<int> label;
+    Matrix<float> data;
+    ReadMnistLabel(label_file, &label);
+    ReadMnistImage(image_file, &data);
+    CHECK(label.size() == data.NumRows());
+    int num_nodes = net.NumNodes();
+
+    Profiler float_profiler, quantize_profiler;
+    double float_accuracy = Evaluate(&net, data, label, batch, &float_profiler);
+    net.Quantize(&quantize_net);
+    double quantize_accuracy = Evaluate(&quantize_net, data, label, batch,
+                                        &quantize_profiler);
+    std::vector<double> float_times = NodeTimes(float_profiler, num_nodes),
+        quantize_times = NodeTimes(quantize_profiler, num_nodes);
+    printf("Float accuracy %.6lf, quantize accuracy %.6lf\n",
+           float_accuracy, quantize_accuracy);
+
+    // Sensitivity of every quantizable layer
+    std::vector<LayerInfo> layers;
+    for (int i = 0; i < num_nodes; i++) {
+        if (quantize_net.GetNode(i)->Type() == net.GetNode(i)->Type()) {
+            continue;
+        }
+        std::vector<bool> mask(num_nodes, false);
+        mask[i] = true;
+        net.Quantize(mask, &mixed_net);
+        LayerInfo layer;
+        layer.id = i;
+        layer.float_us = float_times[i];
+        layer.quantize_us = quantize_times[i];
+        layer.accuracy_drop = float_accuracy -
+            Evaluate(&mixed_net, data, label, batch, nullptr);
+        layers.push_back(layer);
+    }
+    printf("%-6s %-24s %12s %12s %14s\n", "Node", "Name", "Float(us)",
+           "Int8(us)", "AccuracyDrop");
+    for (int i = 0; i < layers.size(); i++) {
+        const Node *node = net.GetNode(layers[i].id);
+        printf("%-6d %-24s %12.2f %12.2f %14.6f\n", layers[i].id,
+               node->Name().empty() ?
+               Node::NodeTypeToString(node->Type()).c_str() :
+               node->Name().c_str(),
+               layers[i].float_us, layers[i].quantize_us,
+               layers[i].accuracy_drop);
+    }
+
+    // Greedy selection, the best gain per accuracy loss first
+    std::sort(layers.begin(), layers.end(),
+        [](const LayerInfo &a, const LayerInfo &b) {
+            return a.Ratio() > b.Ratio();
+        });
+    std::vector<LayerInfo> selected;
+    double budget = max_accuracy_loss;
+    for (int i = 0; i < layers.size(); i++) {
+        if (layers[i].Gain() <= 0) continue;
+        if (layers[i].accuracy_drop <= budget) {
+            selected.push_back(layers[i]);
+            budget -= std::max(layers[i].accuracy_drop, 0.0);
+        }
+    }
+    // Layer drops are not additive, verify and back off the worst layer
+    double mixed_accuracy = float_accuracy;
+    while (true) {
+        std::vector<bool> mask(num_nodes, false);
+        for (int i = 0; i < selected.size(); i++) mask[selected[i].id] = true;
+        net.Quantize(mask, &mixed_net);
+        mixed_accuracy = Evaluate(&mixed_net, data, label, batch, nullptr);
+        if (float_accuracy - mixed_accuracy <= max_accuracy_loss ||
+            selected.empty()) {
+            break;
+        }
+        selected.pop_back();
+    }
+
+    double float_total = 0, mixed_total = 0;
+    for (int i = 0; i < num_nodes; i++) float_total += float_times[i];
+    mixed_total = float_total;
+    printf("Quantized nodes:");
+    for (int i = 0; i < selected.size(); i++) {
+        printf(" %d", selected[i].id);
+        mixed_total -= selected[i].Gain();
+    }
+    printf("\nMixed accuracy %.6lf, estimated time %.2fus vs float %.2fus\n",
+           mixed_accuracy, mixed_total, float_total);
+    mixed_net.ToProto(mixed_net_file);
+    return 0;
+}
@@ -0,0 +1,48 @@
+// Created on 2026-10-19
+// Author: Binbin Zhang
+#include <sstream>
+
+#include "xnet.h"
+#include "pass.h"
+#include "parse-option.h"
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Run the graph passes on a net and write it back\n"
+        "eg: xnet-optimize in.proto out.proto\n";
+    ParseOptions option(usage);
+    std::string passes = "drop-identity,fold-scale,merge-linear";
+    option.Register("passes", &passes, "passes to run in order, comma "
+        "separated, drop-identity|fold-scale|merge-linear");
+    option.Read(argc, argv);
+    if (option.NumArgs() != 2) {
+        option.PrintUsage();
+        exit(1);
+    }
+    std::string in_file = option.GetArg(1), out_file = option.GetArg(2);
+
+    PassManager pass_manager;
+    pass_manager.SetVerbose(true);
+    std::stringstream ss(passes);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        if (name == "drop-identity") {
+            pass_manager.Add(new DropIdentityPass());
+        } else if (name == "fold-scale") {
+            pass_manager.Add(new FoldScalePass());
+        } else if (name == "merge-linear") {
+            pass_manager.Add(new MergeLinearPass());
+        } else if (name != "") {
+            ERROR("unknown pass %s", name.c_str());
+        }
+    }
+
+    XNet net;
+    net.FromProto(in_file, false);
+    std::cout << "before:\n";
+    net.Info();
+    int num_rewrites = net.Optimize(pass_manager);
+    std::cout << "after " << num_rewrites << " rewrites:\n";
+    net.Info();
+    net.ToProto(out_file);
+    return 0;
+}
@@ -0,0 +1,67 @@
+// Created on 2026-10-19
+// Author: Binbin Zhang
+#include <fstream>
+#include <vector>
+
+#include "xnet.h"
+#include "parse-option.h"
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Set the output head of the last node(Softmax or "
+        "fully connect) of a net\n"
+        "eg: xnet-output-head --mode=log-prob --prior-file=prior.txt "
+        "in.proto out.proto\n";
+    ParseOptions option(usage);
+    std::string mode = "none", prior_file = "";
+    int k = 1;
+    option.Register("mode", &mode, "none|log-prob|top-k");
+    option.Register("k", &k, "k of top-k, 1 for argmax");
+    option.Register("prior-file", &prior_file,
+        "text file of the priors(or counts) of the classes, its log is "
+        "subtracted in log-prob or top-k");
+    option.Read(argc, argv);
+    if (option.NumArgs() != 2) {
+        option.PrintUsage();
+        exit(1);
+    }
+    std::string in_file = option.GetArg(1), out_file = option.GetArg(2);
+
+    XNet net(in_file);
+    OutputHead head;
+    if (mode == "log-prob") {
+        head = OutputHead(OutputHeadParameter::LOG_PROB);
+    } else if (mode == "top-k") {
+        if (k <= 0) ERROR("k must be positive, %d given", k);
+        head = OutputHead(OutputHeadParameter::TOP_K, k);
+    } else if (mode != "none") {
+        ERROR("unknown mode %s", mode.c_str());
+    }
+    if (prior_file != "") {
+        if (mode == "none") ERROR("--prior-file needs log-prob or top-k");
+        std::ifstream is(prior_file);
+        if (!is) ERROR("file %s does not exist", prior_file.c_str());
+        std::vector<float> priors;
+        float prior;
+        while (is >> prior) priors.push_back(prior);
+        Vector<float> prior_vec(priors.size());
+        for (int i = 0; i < priors.size(); i++) prior_vec(i) = priors[i];
+        // Classes of the last node without a head, the nodes before the
+        // first one taking a fixed dim keep the dim
+        net.SetOutputHead(OutputHead());
+        int input_dim = 0;
+        for (int i = 0; i < net.NumNodes() && input_dim == 0; i++) {
+            input_dim = net.GetNode(i)->InputDim();
+        }
+        int num_classes = net.OutputDim(input_dim);
+        if (input_dim > 0 && prior_vec.Size() != num_classes) {
+            ERROR("%d priors in %s, but the net has %d classes", 
+                  prior_vec.Size(), prior_file.c_str(), num_classes);
+        }
+        head.SetPrior(prior_vec);
+    }
+
+    net.SetOutputHead(head);
+    net.Info();
+    net.ToProto(out_file);
+    return 0;
+}
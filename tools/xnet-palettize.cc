@@ -0,0 +1,46 @@
+// Created on 2026-10-19
+// Author: Binbin Zhang
+// About: palettize the fully connect weights of a float net to k-means
+//        codebooks, 16 entries take 4 bits and 256 entries 8 bits per weight
+#include <stdio.h>
+
+#include "xnet.h"
+#include "parse-option.h"
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Convert float net to palettized net\n"
+        "eg: xnet-palettize --codebook-size=16 float.proto palette.proto\n";
+    ParseOptions option(usage);
+    int codebook_size = 16, num_iters = 30;
+    option.Register("codebook-size", &codebook_size,
+        "k-means centers of every layer, 2~256");
+    option.Register("num-iters", &num_iters, "max k-means iterations");
+    option.Read(argc, argv);
+    if (option.NumArgs() != 2 || codebook_size < 2 || codebook_size > 256) {
+        option.PrintUsage();
+        exit(1);
+    }
+    std::string float_net_file = option.GetArg(1),
+        palette_net_file = option.GetArg(2);
+
+    XNet net(float_net_file), palette_net;
+    std::vector<float> mse;
+    net.Palettize(codebook_size, num_iters, &palette_net, &mse);
+    palette_net.ToProto(palette_net_file);
+    palette_net.Info();
+    // Bytes on disk, indices are packed to 4 bits for small codebooks
+    int bits = codebook_size <= 16 ? 4 : 8;
+    for (int i = 0; i < net.NumNodes(); i++) {
+        if (net.GetNode(i)->Type() != NodeProto::FULLY_CONNECT) continue;
+        const FullyConnect *fc = 
+            static_cast<const FullyConnect *>(net.GetNode(i));
+        int64_t num_weights = fc->Weight().Size();
+        printf("node %d %s weight %dx%d mse %g, %lld -> %lld bytes\n", i, 
+               fc->Name().c_str(), fc->Weight().NumRows(), 
+               fc->Weight().NumCols(), mse[i], 
+               static_cast<long long>(sizeof(float) * num_weights),
+               static_cast<long long>((num_weights * bits + 7) / 8 + 
+                                      sizeof(float) * codebook_size));
+    }
+    return 0;
+}
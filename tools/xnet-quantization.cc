@@ -8,8 +8,10 @@
 int main(int argc, char *argv[]) {
     const char *usage = "Convert float net to quantize net\n";
     ParseOptions option(usage);
+    int bits = 8;
+    option.Register("bits", &bits, "quantize bits, 8(uint8) or 16(int16)");
     option.Read(argc, argv);
-    if (option.NumArgs() != 2) {
+    if (option.NumArgs() != 2 || (bits != 8 && bits != 16)) {
         option.PrintUsage();
         exit(1);
     }
@@ -17,7 +19,7 @@ int main(int argc, char *argv[]) {
         quantize_net_file = option.GetArg(2);
 
     XNet net(float_net_file), quantize_net;
-    net.Quantize(&quantize_net);
+    net.Quantize(&quantize_net, bits);
     quantize_net.ToProto(quantize_net_file);
     quantize_net.Info();
 }
@@ -0,0 +1,64 @@
+// Created on 2026-10-19
+// Author: Binbin Zhang
+// About: convert the first fully connect of a net to a sparse input one,
+//        so XNet::Forward of a SparseMatrix costs the nonzeros only
+#include "xnet.h"
+#include "parse-option.h"
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Convert the first fully connect node of a net to "
+        "a sparse fully connect(embedding bag)\n"
+        "eg: xnet-sparse-input --combiner=mean in.proto out.proto\n";
+    ParseOptions option(usage);
+    std::string combiner = "sum";
+    option.Register("combiner", &combiner, "combine the rows of the "
+        "nonzeros by sum|mean|sqrtn, sum is the same as the fully connect");
+    option.Read(argc, argv);
+    if (option.NumArgs() != 2) {
+        option.PrintUsage();
+        exit(1);
+    }
+    std::string in_file = option.GetArg(1), out_file = option.GetArg(2);
+
+    SparseFullyConnect::Combiner mode = SparseFullyConnectParameter::SUM;
+    if (combiner == "mean") {
+        mode = SparseFullyConnectParameter::MEAN;
+    } else if (combiner == "sqrtn") {
+        mode = SparseFullyConnectParameter::SQRTN;
+    } else if (combiner != "sum") {
+        ERROR("unknown combiner %s", combiner.c_str());
+    }
+
+    XNet net(in_file), sparse_net;
+    if (net.GetNode(0)->Type() != NodeProto::FULLY_CONNECT) {
+        ERROR("the first node of %s is not a fully connect", in_file.c_str());
+    }
+    const FullyConnect *fc = static_cast<const FullyConnect *>(net.GetNode(0));
+    if (fc->GetOutputHead()->GetMode() != OutputHeadParameter::NONE) {
+        ERROR("the first node has an output head");
+    }
+    // The weight n x k transposed to the table k x n
+    const Matrix<float> &weight = fc->Weight();
+    Matrix<float> table(weight.NumCols(), weight.NumRows());
+    for (int j = 0; j < weight.NumRows(); j++) {
+        for (int p = 0; p < weight.NumCols(); p++) {
+            table(p, j) = weight(j, p);
+        }
+    }
+    SparseFullyConnect *node = new SparseFullyConnect();
+    node->SetName(fc->Name());
+    node->SetTable(std::move(table));
+    if (fc->Bias() != nullptr) {
+        node->SetBias(std::make_shared<const Vector<float> >(*fc->Bias()));
+    }
+    node->SetCombiner(mode);
+    node->FuseActivation(fc->FusedActivation());
+    node->SetActivationName(fc->ActivationName());
+    sparse_net.AddNode(node);
+    for (int i = 1; i < net.NumNodes(); i++) {
+        sparse_net.AddNode(net.GetNode(i)->Copy());
+    }
+    sparse_net.ToProto(out_file);
+    sparse_net.Info();
+    return 0;
+}
@@ -0,0 +1,28 @@
+// Created on 2026-10-19
+// Author: Binbin Zhang
+#include <iostream>
+
+#include "xnet.h"
+#include "parse-option.h"
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Benchmark the kernels of every node and batch size, "
+        "and write the fastest ones to a tune file\n"
+        "eg: xnet-tune --input-dim=784 net.proto net.tune\n";
+    ParseOptions option(usage);
+    int input_dim = 0, max_batch = 512;
+    option.Register("input-dim", &input_dim, "input dim of the net");
+    option.Register("max-batch", &max_batch, "max batch size to tune");
+    option.Read(argc, argv);
+    if (option.NumArgs() != 2 || input_dim <= 0) {
+        option.PrintUsage();
+        exit(1);
+    }
+    std::string net_file = option.GetArg(1), tune_file = option.GetArg(2);
+
+    XNet net(net_file);
+    TuneTable table;
+    net.Tune(input_dim, max_batch, &table);
+    table.Write(tune_file);
+    return 0;
+}
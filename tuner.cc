@@ -0,0 +1,86 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ */
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "tuner.h"
+#include "utils.h"
+
+std::string KernelConfig::ToString() const {
+    std::string name;
+    switch (kernel) {
+        case KERNEL_DEFAULT: name = "default"; break;
+        case KERNEL_BUILTIN: name = "builtin"; break;
+        case KERNEL_BLAS: name = "blas"; break;
+        case KERNEL_GEMMLOWP: name = "gemmlowp"; break;
+        case KERNEL_FLOAT: name = "float"; break;
+        case KERNEL_GEMV: name = "gemv"; break;
+        default: name = "unknown";
+    }
+    if (num_threads > 0) name += "/" + std::to_string(num_threads) + "t";
+    return name;
+}
+
+std::vector<int> TuneThreads() {
+    int num_cores = std::thread::hardware_concurrency();
+    std::vector<int> threads(1, 1);
+    while (threads.back() * 2 <= num_cores) {
+        threads.push_back(threads.back() * 2);
+    }
+    return threads;
+}
+
+int BatchBucket(int batch) {
+    int bucket = 0;
+    while (bucket < kNumBatchBuckets - 1 && BucketBatch(bucket) < batch) {
+        bucket++;
+    }
+    return bucket;
+}
+
+bool TuneTable::Get(int node, int bucket, KernelConfig *config) const {
+    auto it = table_.find(std::make_pair(node, bucket));
+    if (it == table_.end()) return false;
+    *config = it->second;
+    return true;
+}
+
+void TuneTable::Read(const std::string &file) {
+    std::ifstream is(file);
+    if (!is) {
+        ERROR("file %s does not exist", file.c_str());
+    }
+    std::string line, key;
+    table_.clear();
+    CHECK(std::getline(is, line));
+    std::istringstream header(line);
+    header >> key >> signature_;
+    CHECK(key == "signature");
+    while (std::getline(is, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        int node, bucket;
+        KernelConfig config;
+        if (!(ss >> node >> bucket >> config.kernel >> config.num_threads)) {
+            ERROR("bad line in tune file %s: %s", file.c_str(), line.c_str());
+        }
+        Set(node, bucket, config);
+    }
+}
+
+void TuneTable::Write(const std::string &file) const {
+    std::ofstream os(file);
+    if (!os) {
+        ERROR("failed to write %s", file.c_str());
+    }
+    os << "signature " << signature_ << "\n";
+    for (auto it = table_.begin(); it != table_.end(); it++) {
+        os << it->first.first << " " << it->first.second << " "
+           << it->second.kernel << " " << it->second.num_threads
+           << " # batch " << BucketBatch(it->first.second) << " "
+           << it->second.ToString() << "\n";
+    }
+}
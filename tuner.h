@@ -0,0 +1,62 @@
+/* Created on 2026-10-19
+ * Author: Binbin Zhang
+ * About: kernel configurations and the persisted tuning table
+ */
+
+#ifndef TUNER_H_
+#define TUNER_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+enum KernelType {
+    KERNEL_DEFAULT = 0,  // node default, what Forward does without tuning
+    KERNEL_BUILTIN = 1,  // built-in float gemm, no blas
+    KERNEL_BLAS = 2,     // blas float gemm
+    KERNEL_GEMMLOWP = 3, // uint8 gemmlowp gemm
+    KERNEL_FLOAT = 4,    // dequantized weight and float gemm
+    KERNEL_GEMV = 5,     // direct small batch kernel, weight streamed once
+};
+
+struct KernelConfig {
+    KernelConfig(int kernel_type = KERNEL_DEFAULT, int threads = 0):
+        kernel(kernel_type), num_threads(threads) {}
+    int kernel;
+    int num_threads; // <= 0 means library default
+    bool operator == (const KernelConfig &config) const {
+        return kernel == config.kernel && num_threads == config.num_threads;
+    }
+    std::string ToString() const;
+};
+
+// Thread counts worth tuning on this host, 1, 2, 4, ... up to the cores
+std::vector<int> TuneThreads();
+
+// Batch sizes are tuned by power of 2 buckets, 1, 2, 4, ..., 512,
+// batch is rounded up to the bucket, larger batch use the last bucket
+const int kNumBatchBuckets = 10;
+int BatchBucket(int batch);
+inline int BucketBatch(int bucket) { return 1 << bucket; }
+
+// Tuned kernel of every (node, batch bucket), file format:
+//   signature <net signature>
+//   <node> <bucket> <kernel> <num_threads>
+// A table is only valid for the net with the same signature
+class TuneTable {
+public:
+    TuneTable(const std::string &signature = ""): signature_(signature) {}
+    void Set(int node, int bucket, const KernelConfig &config) {
+        table_[std::make_pair(node, bucket)] = config;
+    }
+    // Return false if the (node, bucket) is not tuned
+    bool Get(int node, int bucket, KernelConfig *config) const;
+    const std::string &Signature() const { return signature_; }
+    void Read(const std::string &file);
+    void Write(const std::string &file) const;
+private:
+    std::string signature_;
+    std::map<std::pair<int, int>, KernelConfig> table_;
+};
+
+#endif
@@ -8,6 +8,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <chrono>
+
 #define DISALLOW_COPY_AND_ASSIGN(Type) \
     Type(const Type &); \
     Type& operator=(const Type &)
@@ -34,5 +36,18 @@
         } \
     } while (0)
 
+class Timer {
+public:
+    Timer() { Reset(); }
+    void Reset() { start_ = std::chrono::steady_clock::now(); }
+    // Elapsed microseconds since construction or last Reset()
+    double Elapsed() const {
+        return std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start_).count();
+    }
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
 #endif
 
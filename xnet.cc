@@ -3,11 +3,14 @@
  */
 
 #include <math.h>
+#include <string.h>
 
 #include <fstream>
 #include <algorithm>
+#include <random>
 
 #include "xnet.h"
+#include "pass.h"
 
 std::string Node::NodeTypeToString(NodeProto_NodeType type) {
     switch(type) {
@@ -17,42 +20,227 @@ std::string Node::NodeTypeToString(NodeProto_NodeType type) {
         case NodeProto::SIGMOID: return "<Sigmoid>";
         case NodeProto::TANH: return "<Tanh>";
         case NodeProto::SOFTMAX: return "<Softmax>";
+        case NodeProto::BATCH_NORM: return "<BatchNorm>";
+        case NodeProto::SCALE: return "<Scale>";
+        case NodeProto::IDENTITY: return "<Identity>";
+        case NodeProto::PALETTE_FULLY_CONNECT: return "<PaletteFullyConnect>";
+        case NodeProto::BINARY_FULLY_CONNECT: return "<BinaryFullyConnect>";
+        case NodeProto::TERNARY_FULLY_CONNECT: return "<TernaryFullyConnect>";
+        case NodeProto::SPARSE_FULLY_CONNECT: return "<SparseFullyConnect>";
+        case NodeProto::QUANTIZE_FULLY_CONNECT_16: 
+            return "<QuantizeFullyConnect16>";
         default: return "<Unknown>";
     }
 }
 
-void ReLU::Forward(const Matrix<float> &in, Matrix<float> *out) {
+ActivationType Node::NodeTypeToActivation(NodeProto_NodeType type) {
+    switch(type) {
+        case NodeProto::RELU: return ACTIVATION_RELU;
+        case NodeProto::SIGMOID: return ACTIVATION_SIGMOID;
+        case NodeProto::TANH: return ACTIVATION_TANH;
+        default: return ACTIVATION_NONE;
+    }
+}
+
+NodeProto_NodeType Node::ActivationToNodeType(ActivationType act) {
+    switch(act) {
+        case ACTIVATION_RELU: return NodeProto::RELU;
+        case ACTIVATION_SIGMOID: return NodeProto::SIGMOID;
+        case ACTIVATION_TANH: return NodeProto::TANH;
+        default: return NodeProto::UNKNOWN;
+    }
+}
+
+void Node::Info() const {
+    std::cout << NodeTypeToString(type_);
+    if (FusedActivation() != ACTIVATION_NONE) {
+        std::cout << " " << NodeTypeToString(
+            ActivationToNodeType(FusedActivation()));
+    }
+    const OutputHead *head = GetOutputHead();
+    if (head != nullptr && head->GetMode() != OutputHeadParameter::NONE) {
+        std::cout << " " << head->ToString();
+    }
+    std::cout << "\n";
+}
+
+void OutputHead::FromProto(const OutputHeadParameter &proto) {
+    mode_ = proto.mode();
+    k_ = proto.k();
+    CHECK(k_ > 0);
+    log_prior_.reset();
+    if (proto.has_log_prior()) {
+        Vector<float> *log_prior = new Vector<float>();
+        log_prior->FromProto(proto.log_prior());
+        log_prior_.reset(log_prior);
+    }
+}
+
+void OutputHead::ToProto(OutputHeadParameter *proto) const {
+    proto->set_mode(mode_);
+    if (mode_ == OutputHeadParameter::TOP_K) proto->set_k(k_);
+    if (log_prior_ != nullptr) {
+        log_prior_->ToProto(proto->mutable_log_prior());
+    }
+}
+
+void OutputHead::SetPrior(const Vector<float> &prior) {
+    double sum = 0;
+    for (int i = 0; i < prior.Size(); i++) {
+        CHECK(prior(i) >= 0);
+        sum += prior(i);
+    }
+    if (sum <= 0) ERROR("the sum of the priors is %f", sum);
+    // Classes never seen are floored, or their log prob goes to +inf
+    const float floor = 1e-20;
+    Vector<float> *log_prior = new Vector<float>(prior.Size());
+    for (int i = 0; i < prior.Size(); i++) {
+        (*log_prior)(i) = logf(std::max(static_cast<float>(prior(i) / sum), 
+                                        floor));
+    }
+    log_prior_.reset(log_prior);
+}
+
+std::string OutputHead::ToString() const {
+    std::string str;
+    switch (mode_) {
+        case OutputHeadParameter::LOG_PROB: str = "<LogProb>"; break;
+        case OutputHeadParameter::TOP_K: 
+            str = "<TopK " + std::to_string(k_) + ">"; 
+            break;
+        default: str = "<None>";
+    }
+    if (log_prior_ != nullptr) str += " <LogPrior>";
+    return str;
+}
+
+void OutputHead::Forward(const Matrix<float> &in, Matrix<float> *out) {
     CHECK(out != nullptr);
-    out->Resize(in.NumRows(), in.NumCols());
+    CHECK(log_prior_ == nullptr || log_prior_->Size() == in.NumCols());
+    switch (mode_) {
+        case OutputHeadParameter::LOG_PROB: LogSoftmax(in, out); break;
+        case OutputHeadParameter::TOP_K: TopK(in, out); break;
+        default: ERROR("no output head to forward");
+    }
+}
+
+// log softmax(x) = x - max - log(sum(exp(x - max)))
+void OutputHead::LogSoftmax(const Matrix<float> &in, 
+        Matrix<float> *out) const {
+    int cols = in.NumCols();
+    out->Resize(in.NumRows(), cols);
+    const float *log_prior = 
+        log_prior_ != nullptr ? log_prior_->Data() : nullptr;
     for (int i = 0; i < in.NumRows(); i++) {
-        for (int j = 0; j < in.NumCols(); j++) {
-            (*out)(i, j) = std::max(in(i, j), 0.0f);
+        const float *x = in.Data() + i * in.Stride();
+        float *y = out->Data() + i * out->Stride();
+        float max = *std::max_element(x, x + cols), sum = 0;
+        for (int j = 0; j < cols; j++) {
+            sum += expf(x[j] - max);
+        }
+        float log_z = max + logf(sum);
+        if (log_prior != nullptr) {
+            for (int j = 0; j < cols; j++) y[j] = x[j] - log_z - log_prior[j];
+        } else {
+            for (int j = 0; j < cols; j++) y[j] = x[j] - log_z;
         }
     }
 }
 
-void Sigmoid::Forward(const Matrix<float> &in, Matrix<float> *out) {
-    CHECK(out != nullptr);
-    out->Resize(in.NumRows(), in.NumCols());
+// Larger score first, the smaller index first on ties like a plain argmax
+static inline bool BetterScore(const std::pair<float, int> &a, 
+                               const std::pair<float, int> &b) {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+// A heap of the k best so far with the worst on top, one pass over the row
+void OutputHead::TopK(const Matrix<float> &in, Matrix<float> *out) {
+    int cols = in.NumCols();
+    CHECK(k_ <= cols);
+    out->Resize(in.NumRows(), k_);
+    const float *log_prior = 
+        log_prior_ != nullptr ? log_prior_->Data() : nullptr;
     for (int i = 0; i < in.NumRows(); i++) {
-        for (int j = 0; j < in.NumCols(); j++) {
-            (*out)(i, j) = 1.0 / (1 + exp(-in(i, j)));
+        const float *x = in.Data() + i * in.Stride();
+        heap_.clear();
+        for (int j = 0; j < cols; j++) {
+            std::pair<float, int> score(
+                log_prior != nullptr ? x[j] - log_prior[j] : x[j], j);
+            if (heap_.size() < k_) {
+                heap_.push_back(score);
+                std::push_heap(heap_.begin(), heap_.end(), BetterScore);
+            } else if (BetterScore(score, heap_.front())) {
+                std::pop_heap(heap_.begin(), heap_.end(), BetterScore);
+                heap_.back() = score;
+                std::push_heap(heap_.begin(), heap_.end(), BetterScore);
+            }
         }
+        std::sort_heap(heap_.begin(), heap_.end(), BetterScore);
+        float *y = out->Data() + i * out->Stride();
+        for (int j = 0; j < k_; j++) y[j] = heap_[j].second;
+    }
+}
+
+// in and out may be strided views, run the kernel row by row then
+static void Elementwise(void (*func)(const float *, int, float *), 
+        const Matrix<float> &in, Matrix<float> *out) {
+    if (in.IsContiguous() && out->IsContiguous()) {
+        func(in.Data(), in.Size(), out->Data());
+        return;
+    }
+    for (int i = 0; i < in.NumRows(); i++) {
+        func(in.Data() + i * in.Stride(), in.NumCols(), 
+             out->Data() + i * out->Stride());
+    }
+}
+
+static void Activate(ActivationType act, Matrix<float> *out) {
+    if (act == ACTIVATION_NONE) return;
+    if (out->IsContiguous()) {
+        Activate(act, out->Data(), out->Size(), out->Data());
+        return;
+    }
+    for (int i = 0; i < out->NumRows(); i++) {
+        float *row = out->Data() + i * out->Stride();
+        Activate(act, row, out->NumCols(), row);
     }
 }
 
+void ReLU::Forward(const Matrix<float> &in, Matrix<float> *out) {
+    CHECK(out != nullptr);
+    out->Resize(in.NumRows(), in.NumCols());
+    Elementwise(GetKernels().relu, in, out);
+}
+
+void Sigmoid::Forward(const Matrix<float> &in, Matrix<float> *out) {
+    CHECK(out != nullptr);
+    out->Resize(in.NumRows(), in.NumCols());
+    Elementwise(GetKernels().sigmoid, in, out);
+}
+
 void Tanh::Forward(const Matrix<float> &in, Matrix<float> *out) {
     CHECK(out != nullptr);
     out->Resize(in.NumRows(), in.NumCols());
-    for (int i = 0; i < in.NumRows(); i++) {
-        for (int j = 0; j < in.NumCols(); j++) {
-            (*out)(i, j) = tanh(in(i, j));
-        }
+    Elementwise(GetKernels().tanh, in, out);
+}
+
+void Softmax::FromProtoFunc(const NodeProto &proto) {
+    head_ = OutputHead();
+    if (proto.has_output_head()) head_.FromProto(proto.output_head());
+}
+
+void Softmax::ToProtoFunc(NodeProto *proto) const {
+    if (head_.GetMode() != OutputHeadParameter::NONE) {
+        head_.ToProto(proto->mutable_output_head());
     }
 }
 
 void Softmax::Forward(const Matrix<float> &in, Matrix<float> *out) {
     CHECK(out != nullptr);
+    if (head_.GetMode() != OutputHeadParameter::NONE) {
+        head_.Forward(in, out);
+        return;
+    }
     out->Resize(in.NumRows(), in.NumCols());
     for (int i = 0; i < in.NumRows(); i++) {
         float max = in(i, 0), sum = 0.0; 
@@ -68,48 +256,229 @@ void Softmax::Forward(const Matrix<float> &in, Matrix<float> *out) {
     }
 }
 
+void Identity::Forward(const Matrix<float> &in, Matrix<float> *out) {
+    CHECK(out != nullptr);
+    out->CopyFrom(in);
+}
+
+void Scale::FromProtoFunc(const NodeProto &proto) {
+    CHECK(proto.has_scale_param());
+    const ScaleParameter &param = proto.scale_param();
+    Vector<float> *scale = new Vector<float>();
+    scale->FromProto(param.scale());
+    scale_.reset(scale);
+    bias_.reset();
+    if (param.has_bias()) {
+        Vector<float> *bias = new Vector<float>();
+        bias->FromProto(param.bias());
+        CHECK(bias->Size() == scale->Size());
+        bias_.reset(bias);
+    }
+}
+
+void Scale::ToProtoFunc(NodeProto *proto) const {
+    ScaleParameter *param = proto->mutable_scale_param();
+    scale_->ToProto(param->mutable_scale());
+    if (bias_ != nullptr) {
+        bias_->ToProto(param->mutable_bias());
+    }
+}
+
+void Scale::Forward(const Matrix<float> &in, Matrix<float> *out) {
+    CHECK(out != nullptr);
+    CHECK(in.NumCols() == scale_->Size());
+    out->Resize(in.NumRows(), in.NumCols());
+    const float *scale = scale_->Data(), 
+                *bias = bias_ != nullptr ? bias_->Data() : nullptr;
+    for (int i = 0; i < in.NumRows(); i++) {
+        const float *x = in.Data() + i * in.Stride();
+        float *y = out->Data() + i * out->Stride();
+        for (int j = 0; j < in.NumCols(); j++) {
+            y[j] = scale[j] * x[j] + (bias != nullptr ? bias[j] : 0);
+        }
+    }
+}
+
+void BatchNorm::FromProtoFunc(const NodeProto &proto) {
+    CHECK(proto.has_batch_norm_param());
+    const BatchNormParameter &param = proto.batch_norm_param();
+    param_.reset(new BatchNormParameter(param));
+    Vector<float> mean, variance, gamma, beta;
+    mean.FromProto(param.mean());
+    variance.FromProto(param.variance());
+    int dim = mean.Size();
+    CHECK(variance.Size() == dim);
+    if (param.has_gamma()) {
+        gamma.FromProto(param.gamma());
+        CHECK(gamma.Size() == dim);
+    }
+    if (param.has_beta()) {
+        beta.FromProto(param.beta());
+        CHECK(beta.Size() == dim);
+    }
+    // scale = gamma / sqrt(variance + epsilon), bias = beta - mean * scale
+    Vector<float> *scale = new Vector<float>(dim), *bias = new Vector<float>(dim);
+    for (int i = 0; i < dim; i++) {
+        float g = param.has_gamma() ? gamma(i) : 1.0f, 
+              b = param.has_beta() ? beta(i) : 0.0f;
+        (*scale)(i) = g / sqrtf(variance(i) + param.epsilon());
+        (*bias)(i) = b - mean(i) * (*scale)(i);
+    }
+    scale_.reset(scale);
+    bias_.reset(bias);
+}
+
+void BatchNorm::ToProtoFunc(NodeProto *proto) const {
+    proto->mutable_batch_norm_param()->CopyFrom(*param_);
+}
+
 void FullyConnect::FromProtoFunc(const NodeProto &proto) {
     CHECK(proto.has_fully_connect_param());
     const FullyConnectParameter &param = proto.fully_connect_param();
     has_bias_ = false;
-    weight_.FromProto(param.weight());
+    Matrix<float> *weight = new Matrix<float>();
+    weight->FromProto(param.weight());
+    weight_.reset(weight);
     if (param.has_bias()) { 
-        bias_.FromProto(param.bias());
+        Vector<float> *bias = new Vector<float>();
+        bias->FromProto(param.bias());
+        bias_.reset(bias);
         has_bias_ = true;
     }
+    head_ = OutputHead();
+    if (proto.has_output_head()) head_.FromProto(proto.output_head());
 }
 
 void FullyConnect::ToProtoFunc(NodeProto *proto) const {
     FullyConnectParameter *param = proto->mutable_fully_connect_param();
-    weight_.ToProto(param->mutable_weight());
+    weight_->ToProto(param->mutable_weight());
     if (has_bias_) {
-        bias_.ToProto(param->mutable_bias());
+        bias_->ToProto(param->mutable_bias());
+    }
+    if (head_.GetMode() != OutputHeadParameter::NONE) {
+        head_.ToProto(proto->mutable_output_head());
     }
 }
 
-Node* FullyConnect::Quantize() const {
+Node* FullyConnect::Quantize(int bits) const {
+    if (bits == 16) {
+        QuantizeFullyConnect16 *node = new QuantizeFullyConnect16();
+        node->SetName(name_);
+        node->SetWeight(*weight_);
+        if (has_bias_) {
+            node->SetBias(bias_);
+        }
+        node->FuseActivation(activation_);
+        node->SetActivationName(activation_name_);
+        node->SetOutputHead(head_);
+        return node;
+    }
+    CHECK(bits == 8);
     QuantizeFullyConnect *node = new QuantizeFullyConnect();
-    Matrix<uint8_t> quantize_weight(weight_.NumRows(), weight_.NumCols());
+    node->SetName(name_);
+    Matrix<uint8_t> quantize_weight(weight_->NumRows(), weight_->NumCols());
     float scale = 0;
     uint8_t zero_point= 0;
-    QuantizeData(weight_.Data(), weight_.Size(), &scale, &zero_point, 
+    QuantizeData(weight_->Data(), weight_->Size(), &scale, &zero_point, 
                  quantize_weight.Data());
-    node->SetWeight(quantize_weight);
+    node->SetWeight(std::move(quantize_weight));
     node->SetWeightScale(scale);
     node->SetWeightZeroPoint(zero_point);
     node->SetHasBias(has_bias_);
     if (has_bias_) {
         node->SetBias(bias_);
     }
+    node->FuseActivation(activation_);
+    node->SetActivationName(activation_name_);
+    node->SetOutputHead(head_);
     return node;
 }
 
+Node* FullyConnect::Binarize(bool ternary, int input_bits) const {
+    BinaryFullyConnect *node = new BinaryFullyConnect(ternary ? 
+        NodeProto::TERNARY_FULLY_CONNECT : NodeProto::BINARY_FULLY_CONNECT);
+    node->SetName(name_);
+    node->SetWeight(*weight_);
+    node->SetInputBits(input_bits);
+    if (has_bias_) {
+        node->SetBias(bias_);
+    }
+    node->FuseActivation(activation_);
+    node->SetActivationName(activation_name_);
+    node->SetOutputHead(head_);
+    return node;
+}
+
+Node* FullyConnect::Palettize(int codebook_size, int num_iters, 
+        float *mse) const {
+    PaletteFullyConnect *node = new PaletteFullyConnect();
+    node->SetName(name_);
+    Vector<float> codebook(codebook_size);
+    Matrix<uint8_t> index(weight_->NumRows(), weight_->NumCols());
+    float error = PalettizeData(weight_->Data(), weight_->Size(), 
+        codebook_size, num_iters, codebook.Data(), index.Data());
+    if (mse != nullptr) *mse = error;
+    node->SetPalette(codebook, std::move(index));
+    if (has_bias_) {
+        node->SetBias(bias_);
+    }
+    node->FuseActivation(activation_);
+    node->SetActivationName(activation_name_);
+    node->SetOutputHead(head_);
+    return node;
+}
+
+bool FullyConnect::FuseActivation(ActivationType act) {
+    if (activation_ != ACTIVATION_NONE || 
+        head_.GetMode() != OutputHeadParameter::NONE) return false;
+    activation_ = act;
+    return true;
+}
+
+bool FullyConnect::SetOutputHead(const OutputHead &head) {
+    if (activation_ != ACTIVATION_NONE) return false;
+    head_ = head;
+    return true;
+}
+
+std::vector<KernelConfig> FullyConnect::KernelConfigs() const {
+    std::vector<KernelConfig> kernels;
+    kernels.push_back(KernelConfig(KERNEL_GEMV));
+    kernels.push_back(KernelConfig(KERNEL_BUILTIN));
+#ifdef USE_BLAS
+    std::vector<int> threads = TuneThreads();
+    for (int i = 0; i < threads.size(); i++) {
+        kernels.push_back(KernelConfig(KERNEL_BLAS, threads[i]));
+    }
+#endif
+    return kernels;
+}
+
 void FullyConnect::Forward(const Matrix<float> &in, Matrix<float> *out) {
     CHECK(out != nullptr);
-    out->Resize(in.NumRows(), weight_.NumRows());
-    out->Mul(in, weight_, true);
-    if (has_bias_) {
-        out->AddVec(bias_);
+    // The logits go to out unless the head changes the shape
+    Matrix<float> *logits = 
+        head_.GetMode() == OutputHeadParameter::TOP_K ? &logits_ : out;
+    logits->Resize(in.NumRows(), weight_->NumRows());
+    if (kernel_.kernel == KERNEL_GEMV || 
+        (kernel_.kernel == KERNEL_DEFAULT && in.NumRows() <= kGemvBatch)) {
+        GetKernels().sgemv(in.NumRows(), weight_->NumRows(), weight_->NumCols(),
+            in.Data(), in.Stride(), weight_->Data(), 
+            has_bias_ ? bias_->Data() : nullptr, activation_, 
+            logits->Data(), logits->Stride());
+    } else {
+        if (kernel_.kernel == KERNEL_BUILTIN) {
+            logits->MulBuiltin(in, *weight_, true);
+        } else {
+            logits->Mul(in, *weight_, true);
+        }
+        if (has_bias_) {
+            logits->AddVec(*bias_);
+        }
+        Activate(activation_, logits);
+    }
+    if (head_.GetMode() != OutputHeadParameter::NONE) {
+        head_.Forward(*logits, out);
     }
 }
 
@@ -118,48 +487,765 @@ void QuantizeFullyConnect::FromProtoFunc(const NodeProto &proto) {
     const QuantizeFullyConnectParameter &param = 
         proto.quantize_fully_connect_param();
     has_bias_ = false;
-    weight_.FromProto(param.weight().tensor());
+    Matrix<uint8_t> *weight = new Matrix<uint8_t>();
+    weight->FromProto(param.weight().tensor());
+    weight_.reset(weight);
+    float_weight_.reset();
+    PackWeight();
     w_scale_ = param.weight().scale();
     w_zero_point_ = static_cast<uint8_t>(param.weight().zero_point());
     if (param.has_bias()) { 
-        bias_.FromProto(param.bias());
+        Vector<float> *bias = new Vector<float>();
+        bias->FromProto(param.bias());
+        bias_.reset(bias);
         has_bias_ = true;
     }
+    head_ = OutputHead();
+    if (proto.has_output_head()) head_.FromProto(proto.output_head());
 }
 
 void QuantizeFullyConnect::ToProtoFunc(NodeProto *proto) const {
     QuantizeFullyConnectParameter *param = 
         proto->mutable_quantize_fully_connect_param();
-    weight_.ToProto(param->mutable_weight()->mutable_tensor());
+    weight_->ToProto(param->mutable_weight()->mutable_tensor());
     param->mutable_weight()->set_scale(w_scale_);
     param->mutable_weight()->set_zero_point(w_zero_point_);
     if (has_bias_) {
-        bias_.ToProto(param->mutable_bias());
+        bias_->ToProto(param->mutable_bias());
+    }
+    if (head_.GetMode() != OutputHeadParameter::NONE) {
+        head_.ToProto(proto->mutable_output_head());
+    }
+}
+
+void QuantizeFullyConnect::PackWeight() {
+    if (GetKernels().u8_gemm_packed != nullptr) {
+        PackedU8Weight *packed = new PackedU8Weight();
+        PackU8Weight(weight_->Data(), weight_->NumRows(), weight_->NumCols(), 
+                     packed);
+        packed_weight_.reset(packed);
+    }
+}
+
+bool QuantizeFullyConnect::FuseActivation(ActivationType act) {
+    if (activation_ != ACTIVATION_NONE || 
+        head_.GetMode() != OutputHeadParameter::NONE) return false;
+    activation_ = act;
+    return true;
+}
+
+bool QuantizeFullyConnect::SetOutputHead(const OutputHead &head) {
+    if (activation_ != ACTIVATION_NONE) return false;
+    head_ = head;
+    return true;
+}
+
+std::vector<KernelConfig> QuantizeFullyConnect::KernelConfigs() const {
+    std::vector<KernelConfig> kernels;
+    if (GetKernels().u8_gemm_packed != nullptr) {
+        kernels.push_back(KernelConfig(KERNEL_GEMV));
+    }
+    std::vector<int> threads = TuneThreads();
+    for (int i = 0; i < threads.size(); i++) {
+        kernels.push_back(KernelConfig(KERNEL_GEMMLOWP, threads[i]));
+    }
+    kernels.push_back(KernelConfig(KERNEL_FLOAT));
+    return kernels;
+}
+
+void QuantizeFullyConnect::PrepareKernel(const KernelConfig &kernel) {
+    if (kernel.kernel != KERNEL_FLOAT || float_weight_ != nullptr) return;
+    Matrix<float> *float_weight = 
+        new Matrix<float>(weight_->NumRows(), weight_->NumCols());
+    for (int i = 0; i < weight_->Size(); i++) {
+        float_weight->Data()[i] = 
+            w_scale_ * (weight_->Data()[i] - w_zero_point_);
+    }
+    float_weight_.reset(float_weight);
+}
+
+void QuantizeFullyConnect::ForwardFloat(const Matrix<float> &in, 
+        Matrix<float> *out) {
+    // Built already by SetKernel or SetTuneTable unless the weight changed
+    PrepareKernel(kernel_);
+    out->Mul(in, *float_weight_, true);
+    if (has_bias_) {
+        out->AddVec(*bias_);
     }
+    Activate(activation_, out);
 }
 
 void QuantizeFullyConnect::Forward(const Matrix<float> &in, 
         Matrix<float> *out) {
     CHECK(out != nullptr);
-    out->Resize(in.NumRows(), weight_.NumRows());
+    // The logits go to out unless the head changes the shape
+    Matrix<float> *logits = 
+        head_.GetMode() == OutputHeadParameter::TOP_K ? &logits_ : out;
+    logits->Resize(in.NumRows(), weight_->NumRows());
+    if (kernel_.kernel == KERNEL_FLOAT) {
+        ForwardFloat(in, logits);
+    } else {
+        ForwardInt8(in, logits);
+    }
+    if (head_.GetMode() != OutputHeadParameter::NONE) {
+        head_.Forward(*logits, out);
+    }
+}
+
+void QuantizeFullyConnect::ForwardInt8(const Matrix<float> &in, 
+        Matrix<float> *out) {
     // quantize in
     float in_scale;
     uint8_t in_zero_point;
-    quantize_in_.Resize(in.NumRows(), in.NumCols());
-    QuantizeData(in.Data(), in.NumRows() * in.NumCols(), &in_scale, 
-        &in_zero_point, quantize_in_.Data());
+    {
+        ProfileScope scope("quantize");
+        QuantizeData(in, &in_scale, &in_zero_point, &quantize_in_);
+    }
     //// uint8 gemm
     quantize_out_.Resize(out->NumRows(), out->NumCols());
-    IntegerGemm<true>(quantize_in_, weight_, static_cast<int>(in_zero_point), 
-        static_cast<int>(w_zero_point_), &quantize_out_);
-    //// dequantize
-    float out_scale = in_scale * w_scale_;
-    DequantizeData(quantize_out_.Data(), out->NumRows() * out->NumCols(), 
-        out_scale, 0, out->Data());
-    //// add bias
+    {
+        ProfileScope scope("gemm");
+        const Kernels &kernels = GetKernels();
+        bool use_packed = kernels.u8_gemm_packed != nullptr && 
+            (kernel_.kernel == KERNEL_GEMV || 
+             (kernel_.kernel == KERNEL_DEFAULT && in.NumRows() <= kSmallBatch));
+        if (use_packed) {
+            kernels.u8_gemm_packed(in.NumRows(), quantize_in_.Data(), 
+                *packed_weight_, in_zero_point, w_zero_point_, 
+                quantize_out_.Data());
+        } else {
+            IntegerGemm<true>(quantize_in_, *weight_, 
+                static_cast<int>(in_zero_point), 
+                static_cast<int>(w_zero_point_), &quantize_out_, 
+                kernel_.num_threads);
+        }
+    }
+    //// dequantize, add bias and activation in one pass
+    {
+        ProfileScope scope("dequantize");
+        float out_scale = in_scale * w_scale_;
+        const float *bias = has_bias_ ? bias_->Data() : nullptr;
+        for (int i = 0; i < out->NumRows(); i++) {
+            GetKernels().dequantize_bias(
+                quantize_out_.Data() + i * out->NumCols(), out->NumCols(), 
+                out_scale, bias, activation_, out->Data() + i * out->Stride());
+        }
+    }
+}
+
+void QuantizeFullyConnect16::FromProtoFunc(const NodeProto &proto) {
+    CHECK(proto.has_quantize_fully_connect16_param());
+    const QuantizeFullyConnectParameter &param = 
+        proto.quantize_fully_connect16_param();
+    CHECK(param.weight().zero_point() == 0);
+    Matrix<int16_t> *weight = new Matrix<int16_t>();
+    weight->FromProto(param.weight().tensor());
+    // Out of the range, the int32 sums of s16_gemm can overflow
+    for (int i = 0; i < weight->Size(); i++) {
+        CHECK(weight->Data()[i] >= -kS16Max && weight->Data()[i] <= kS16Max);
+    }
+    weight_.reset(weight);
+    w_scale_ = param.weight().scale();
+    has_bias_ = false;
+    bias_.reset();
+    if (param.has_bias()) { 
+        Vector<float> *bias = new Vector<float>();
+        bias->FromProto(param.bias());
+        bias_.reset(bias);
+        has_bias_ = true;
+    }
+    head_ = OutputHead();
+    if (proto.has_output_head()) head_.FromProto(proto.output_head());
+}
+
+void QuantizeFullyConnect16::ToProtoFunc(NodeProto *proto) const {
+    QuantizeFullyConnectParameter *param = 
+        proto->mutable_quantize_fully_connect16_param();
+    weight_->ToProto(param->mutable_weight()->mutable_tensor());
+    param->mutable_weight()->set_scale(w_scale_);
+    param->mutable_weight()->set_zero_point(0);
+    if (has_bias_) {
+        bias_->ToProto(param->mutable_bias());
+    }
+    if (head_.GetMode() != OutputHeadParameter::NONE) {
+        head_.ToProto(proto->mutable_output_head());
+    }
+}
+
+void QuantizeFullyConnect16::SetWeight(const Matrix<float> &weight) {
+    const Kernels &kernels = GetKernels();
+    float min = 0, max = 0;
+    for (int i = 0; i < weight.NumRows(); i++) {
+        float row_min, row_max;
+        kernels.min_max(weight.Data() + i * weight.Stride(), 
+                        weight.NumCols(), &row_min, &row_max);
+        min = std::min(min, row_min);
+        max = std::max(max, row_max);
+    }
+    w_scale_ = std::max(-min, max) / kS16Max;
+    Matrix<int16_t> *quantize_weight = 
+        new Matrix<int16_t>(weight.NumRows(), weight.NumCols());
+    for (int i = 0; i < weight.NumRows(); i++) {
+        kernels.quantize_s16(weight.Data() + i * weight.Stride(), 
+            weight.NumCols(), w_scale_, 
+            quantize_weight->Data() + i * quantize_weight->Stride());
+    }
+    weight_.reset(quantize_weight);
+}
+
+bool QuantizeFullyConnect16::FuseActivation(ActivationType act) {
+    if (activation_ != ACTIVATION_NONE || 
+        head_.GetMode() != OutputHeadParameter::NONE) return false;
+    activation_ = act;
+    return true;
+}
+
+bool QuantizeFullyConnect16::SetOutputHead(const OutputHead &head) {
+    if (activation_ != ACTIVATION_NONE) return false;
+    head_ = head;
+    return true;
+}
+
+void QuantizeFullyConnect16::Forward(const Matrix<float> &in, 
+        Matrix<float> *out) {
+    CHECK(out != nullptr);
+    CHECK(in.NumCols() == weight_->NumCols());
+    // The logits go to out unless the head changes the shape
+    Matrix<float> *logits = 
+        head_.GetMode() == OutputHeadParameter::TOP_K ? &logits_ : out;
+    logits->Resize(in.NumRows(), weight_->NumRows());
+    const Kernels &kernels = GetKernels();
+    //// quantize in, per row
+    {
+        ProfileScope scope("quantize");
+        quantize_in_.Resize(in.NumRows(), in.NumCols());
+        in_scale_.resize(in.NumRows());
+        for (int i = 0; i < in.NumRows(); i++) {
+            const float *x = in.Data() + i * in.Stride();
+            float min, max;
+            kernels.min_max(x, in.NumCols(), &min, &max);
+            in_scale_[i] = std::max(-min, max) / kS16Max;
+            kernels.quantize_s16(x, in.NumCols(), in_scale_[i], 
+                quantize_in_.Data() + i * quantize_in_.Stride());
+        }
+    }
+    //// int16 gemm
+    {
+        ProfileScope scope("gemm");
+        kernels.s16_gemm(in.NumRows(), weight_->NumRows(), 
+            weight_->NumCols(), quantize_in_.Data(), weight_->Data(), 
+            logits->Data(), logits->Stride());
+    }
+    //// dequantize, add bias and activation
+    {
+        ProfileScope scope("dequantize");
+        for (int i = 0; i < logits->NumRows(); i++) {
+            float *y = logits->Data() + i * logits->Stride();
+            float scale = in_scale_[i] * w_scale_;
+            for (int j = 0; j < logits->NumCols(); j++) y[j] *= scale;
+        }
+        if (has_bias_) {
+            logits->AddVec(*bias_);
+        }
+        Activate(activation_, logits);
+    }
+    if (head_.GetMode() != OutputHeadParameter::NONE) {
+        head_.Forward(*logits, out);
+    }
+}
+
+void PaletteFullyConnect::FromProtoFunc(const NodeProto &proto) {
+    CHECK(proto.has_palette_fully_connect_param());
+    const PaletteFullyConnectParameter &param = 
+        proto.palette_fully_connect_param();
+    Vector<float> codebook;
+    codebook.FromProto(param.codebook());
+    CHECK(param.shape_size() == 2);
+    int n = param.shape(0), k = param.shape(1);
+    Matrix<uint8_t> index(n, k);
+    const std::string &bytes = param.index();
+    if (codebook.Size() <= 16) {
+        CHECK(bytes.size() == (index.Size() + 1) / 2);
+        for (int i = 0; i < index.Size(); i++) {
+            uint8_t byte = static_cast<uint8_t>(bytes[i / 2]);
+            index.Data()[i] = i % 2 == 0 ? byte & 0x0f : byte >> 4;
+        }
+    } else {
+        CHECK(bytes.size() == index.Size());
+        memcpy(index.Data(), bytes.data(), bytes.size());
+    }
+    SetPalette(codebook, std::move(index));
+    has_bias_ = false;
+    bias_.reset();
+    if (param.has_bias()) { 
+        Vector<float> *bias = new Vector<float>();
+        bias->FromProto(param.bias());
+        bias_.reset(bias);
+        has_bias_ = true;
+    }
+    head_ = OutputHead();
+    if (proto.has_output_head()) head_.FromProto(proto.output_head());
+}
+
+void PaletteFullyConnect::ToProtoFunc(NodeProto *proto) const {
+    PaletteFullyConnectParameter *param = 
+        proto->mutable_palette_fully_connect_param();
+    Vector<float> codebook(codebook_size_);
+    memcpy(codebook.Data(), codebook_->Data(), 
+           sizeof(float) * codebook_size_);
+    codebook.ToProto(param->mutable_codebook());
+    param->add_shape(index_->NumRows());
+    param->add_shape(index_->NumCols());
+    const uint8_t *index = index_->Data();
+    std::string bytes;
+    if (codebook_size_ <= 16) {
+        bytes.resize((index_->Size() + 1) / 2, 0);
+        for (int i = 0; i < index_->Size(); i++) {
+            bytes[i / 2] |= index[i] << (i % 2 == 0 ? 0 : 4);
+        }
+    } else {
+        bytes.assign(reinterpret_cast<const char *>(index), index_->Size());
+    }
+    param->set_index(bytes);
+    if (has_bias_) {
+        bias_->ToProto(param->mutable_bias());
+    }
+    if (head_.GetMode() != OutputHeadParameter::NONE) {
+        head_.ToProto(proto->mutable_output_head());
+    }
+}
+
+void PaletteFullyConnect::SetPalette(const Vector<float> &codebook, 
+        Matrix<uint8_t> index) {
+    codebook_size_ = codebook.Size();
+    CHECK(codebook_size_ >= 2 && codebook_size_ <= 256);
+    CHECK(index.IsContiguous());
+    for (int i = 0; i < index.Size(); i++) {
+        CHECK(index.Data()[i] < codebook_size_);
+    }
+    Vector<float> *padded = new Vector<float>(256);
+    memset(padded->Data(), 0, sizeof(float) * 256);
+    memcpy(padded->Data(), codebook.Data(), sizeof(float) * codebook_size_);
+    codebook_.reset(padded);
+    index_.reset(new Matrix<uint8_t>(std::move(index)));
+}
+
+bool PaletteFullyConnect::FuseActivation(ActivationType act) {
+    if (activation_ != ACTIVATION_NONE || 
+        head_.GetMode() != OutputHeadParameter::NONE) return false;
+    activation_ = act;
+    return true;
+}
+
+bool PaletteFullyConnect::SetOutputHead(const OutputHead &head) {
+    if (activation_ != ACTIVATION_NONE) return false;
+    head_ = head;
+    return true;
+}
+
+std::vector<KernelConfig> PaletteFullyConnect::KernelConfigs() const {
+    std::vector<KernelConfig> kernels;
+    kernels.push_back(KernelConfig(KERNEL_GEMV));
+    std::vector<int> threads = TuneThreads();
+    for (int i = 0; i < threads.size(); i++) {
+        kernels.push_back(KernelConfig(KERNEL_FLOAT, threads[i]));
+    }
+    return kernels;
+}
+
+void PaletteFullyConnect::ForwardFloat(const Matrix<float> &in, 
+        Matrix<float> *out) {
+    int n = index_->NumRows(), k = index_->NumCols();
+    int tile_rows = std::min(n, std::max(16, kFloatTileSize / k));
+    const float *codebook = codebook_->Data();
+    for (int begin = 0; begin < n; begin += tile_rows) {
+        int rows = std::min(tile_rows, n - begin);
+        float_tile_.Resize(rows, k);
+        const uint8_t *index = index_->Data() + begin * k;
+        for (int i = 0; i < rows * k; i++) {
+            float_tile_.Data()[i] = codebook[index[i]];
+        }
+        // Columns [begin, begin + rows) of out
+        Matrix<float> out_tile(out->Data() + begin, out->NumRows(), rows, 
+                               out->Stride());
+        out_tile.Mul(in, float_tile_, true);
+    }
+    if (has_bias_) {
+        out->AddVec(*bias_);
+    }
+    Activate(activation_, out);
+}
+
+void PaletteFullyConnect::Forward(const Matrix<float> &in, 
+        Matrix<float> *out) {
+    CHECK(out != nullptr);
+    // The logits go to out unless the head changes the shape
+    Matrix<float> *logits = 
+        head_.GetMode() == OutputHeadParameter::TOP_K ? &logits_ : out;
+    logits->Resize(in.NumRows(), index_->NumRows());
+    if (kernel_.kernel == KERNEL_GEMV || 
+        (kernel_.kernel == KERNEL_DEFAULT && in.NumRows() <= kGemvBatch)) {
+        GetKernels().palette_gemv(in.NumRows(), index_->NumRows(), 
+            index_->NumCols(), in.Data(), in.Stride(), index_->Data(), 
+            codebook_->Data(), codebook_size_, 
+            has_bias_ ? bias_->Data() : nullptr, activation_, 
+            logits->Data(), logits->Stride());
+    } else {
+        ForwardFloat(in, logits);
+    }
+    if (head_.GetMode() != OutputHeadParameter::NONE) {
+        head_.Forward(*logits, out);
+    }
+}
+
+// Bit planes to bytes of little endian words and back
+static std::string BitsToBytes(const std::vector<uint64_t> &bits) {
+    std::string bytes(sizeof(uint64_t) * bits.size(), 0);
+    for (int i = 0; i < bits.size(); i++) {
+        for (int b = 0; b < sizeof(uint64_t); b++) {
+            bytes[i * sizeof(uint64_t) + b] = (bits[i] >> (8 * b)) & 0xff;
+        }
+    }
+    return bytes;
+}
+
+static std::vector<uint64_t> BytesToBits(const std::string &bytes, 
+        int num_words) {
+    CHECK(bytes.size() == sizeof(uint64_t) * num_words);
+    std::vector<uint64_t> bits(num_words, 0);
+    for (int i = 0; i < num_words; i++) {
+        for (int b = 0; b < sizeof(uint64_t); b++) {
+            uint64_t byte = static_cast<uint8_t>(
+                bytes[i * sizeof(uint64_t) + b]);
+            bits[i] |= byte << (8 * b);
+        }
+    }
+    return bits;
+}
+
+void BinaryFullyConnect::FromProtoFunc(const NodeProto &proto) {
+    CHECK(proto.has_binary_fully_connect_param());
+    const BinaryFullyConnectParameter &param = 
+        proto.binary_fully_connect_param();
+    CHECK(param.shape_size() == 2);
+    n_ = param.shape(0);
+    k_ = param.shape(1);
+    words_ = (k_ + 63) / 64;
+    positive_.reset(new std::vector<uint64_t>(
+        BytesToBits(param.positive(), n_ * words_)));
+    negative_.reset();
+    if (IsTernary()) {
+        CHECK(param.has_negative());
+        negative_.reset(new std::vector<uint64_t>(
+            BytesToBits(param.negative(), n_ * words_)));
+    }
+    Vector<float> *scale = new Vector<float>();
+    scale->FromProto(param.scale());
+    CHECK(scale->Size() == n_);
+    scale_.reset(scale);
+    ComputeWeightSum();
+    SetInputBits(param.input_bits());
+    has_bias_ = false;
+    bias_.reset();
+    if (param.has_bias()) { 
+        Vector<float> *bias = new Vector<float>();
+        bias->FromProto(param.bias());
+        bias_.reset(bias);
+        has_bias_ = true;
+    }
+    head_ = OutputHead();
+    if (proto.has_output_head()) head_.FromProto(proto.output_head());
+}
+
+void BinaryFullyConnect::ToProtoFunc(NodeProto *proto) const {
+    BinaryFullyConnectParameter *param = 
+        proto->mutable_binary_fully_connect_param();
+    param->add_shape(n_);
+    param->add_shape(k_);
+    param->set_positive(BitsToBytes(*positive_));
+    if (IsTernary()) {
+        param->set_negative(BitsToBytes(*negative_));
+    }
+    scale_->ToProto(param->mutable_scale());
+    param->set_input_bits(input_bits_);
+    if (has_bias_) {
+        bias_->ToProto(param->mutable_bias());
+    }
+    if (head_.GetMode() != OutputHeadParameter::NONE) {
+        head_.ToProto(proto->mutable_output_head());
+    }
+}
+
+void BinaryFullyConnect::SetWeight(const Matrix<float> &weight) {
+    n_ = weight.NumRows();
+    k_ = weight.NumCols();
+    words_ = (k_ + 63) / 64;
+    std::vector<uint64_t> *positive = 
+        new std::vector<uint64_t>(n_ * words_, 0);
+    std::vector<uint64_t> *negative = 
+        IsTernary() ? new std::vector<uint64_t>(n_ * words_, 0) : nullptr;
+    Vector<float> *scale = new Vector<float>(n_);
+    for (int j = 0; j < n_; j++) {
+        const float *w = weight.Data() + j * weight.Stride();
+        double abs_sum = 0;
+        for (int p = 0; p < k_; p++) abs_sum += fabs(w[p]);
+        float threshold = IsTernary() ? 0.7 * abs_sum / k_ : 0;
+        double kept_sum = 0;
+        int num_kept = 0;
+        uint64_t *pos_row = positive->data() + j * words_;
+        for (int p = 0; p < k_; p++) {
+            uint64_t bit = 1ULL << (p % 64);
+            if (!IsTernary()) {
+                if (w[p] >= 0) pos_row[p / 64] |= bit;
+            } else if (w[p] > threshold) {
+                pos_row[p / 64] |= bit;
+            } else if (w[p] < -threshold) {
+                (*negative)[j * words_ + p / 64] |= bit;
+            } else {
+                continue;
+            }
+            kept_sum += fabs(w[p]);
+            num_kept++;
+        }
+        scale->Data()[j] = num_kept > 0 ? kept_sum / num_kept : 0;
+    }
+    positive_.reset(positive);
+    negative_.reset(negative);
+    scale_.reset(scale);
+    ComputeWeightSum();
+}
+
+void BinaryFullyConnect::ComputeWeightSum() {
+    std::vector<int32_t> *weight_sum = new std::vector<int32_t>(n_, 0);
+    for (int j = 0; j < n_; j++) {
+        int num_positive = 0, num_negative = 0;
+        for (int p = 0; p < words_; p++) {
+            num_positive += __builtin_popcountll((*positive_)[j * words_ + p]);
+            if (IsTernary()) {
+                num_negative += 
+                    __builtin_popcountll((*negative_)[j * words_ + p]);
+            }
+        }
+        if (!IsTernary()) num_negative = k_ - num_positive;
+        (*weight_sum)[j] = num_positive - num_negative;
+    }
+    weight_sum_.reset(weight_sum);
+}
+
+bool BinaryFullyConnect::FuseActivation(ActivationType act) {
+    if (activation_ != ACTIVATION_NONE || 
+        head_.GetMode() != OutputHeadParameter::NONE) return false;
+    activation_ = act;
+    return true;
+}
+
+bool BinaryFullyConnect::SetOutputHead(const OutputHead &head) {
+    if (activation_ != ACTIVATION_NONE) return false;
+    head_ = head;
+    return true;
+}
+
+void BinaryFullyConnect::QuantizeInput(const Matrix<float> &in) {
+    int m = in.NumRows(), num_planes = m * input_bits_;
+    int max_q = (1 << input_bits_) - 1;
+    x_bits_.assign(num_planes * words_, 0);
+    x_scale_.resize(m);
+    x_offset_.resize(m);
+    for (int i = 0; i < m; i++) {
+        const float *x = in.Data() + i * in.Stride();
+        uint64_t *bits = x_bits_.data() + i * input_bits_ * words_;
+        if (input_bits_ == 1) {
+            // x = 2a * (x >= 0) - a, a = mean(|x|)
+            double abs_sum = 0;
+            for (int p = 0; p < k_; p++) {
+                abs_sum += fabs(x[p]);
+                if (x[p] >= 0) bits[p / 64] |= 1ULL << (p % 64);
+            }
+            x_scale_[i] = 2 * abs_sum / k_;
+            x_offset_[i] = -abs_sum / k_;
+            continue;
+        }
+        float min, max;
+        GetKernels().min_max(x, k_, &min, &max);
+        float scale = (max - min) / max_q, 
+              inv_scale = scale > 0 ? 1 / scale : 0;
+        x_scale_[i] = scale;
+        x_offset_[i] = min;
+        for (int p = 0; p < k_; p++) {
+            int q = std::min(max_q, 
+                static_cast<int>((x[p] - min) * inv_scale + 0.5f));
+            for (int b = 0; b < input_bits_; b++) {
+                bits[b * words_ + p / 64] |= 
+                    static_cast<uint64_t>((q >> b) & 1) << (p % 64);
+            }
+        }
+    }
+    if (!IsTernary()) {
+        x_count_.resize(num_planes);
+        for (int i = 0; i < num_planes; i++) {
+            int32_t count = 0;
+            for (int p = 0; p < words_; p++) {
+                count += __builtin_popcountll(x_bits_[i * words_ + p]);
+            }
+            x_count_[i] = count;
+        }
+    }
+}
+
+void BinaryFullyConnect::Forward(const Matrix<float> &in, 
+        Matrix<float> *out) {
+    CHECK(out != nullptr);
+    CHECK(in.NumCols() == k_);
+    // The logits go to out unless the head changes the shape
+    Matrix<float> *logits = 
+        head_.GetMode() == OutputHeadParameter::TOP_K ? &logits_ : out;
+    int m = in.NumRows(), num_planes = m * input_bits_;
+    logits->Resize(m, n_);
+    {
+        ProfileScope scope("quantize");
+        QuantizeInput(in);
+    }
+    {
+        ProfileScope scope("popcount");
+        const Kernels &kernels = GetKernels();
+        positive_count_.Resize(num_planes, n_);
+        kernels.and_popcount(num_planes, n_, words_, x_bits_.data(), words_,
+            positive_->data(), positive_count_.Data(), n_);
+        if (IsTernary()) {
+            negative_count_.Resize(num_planes, n_);
+            kernels.and_popcount(num_planes, n_, words_, x_bits_.data(), 
+                words_, negative_->data(), negative_count_.Data(), n_);
+        }
+    }
+    {
+        ProfileScope scope("dequantize");
+        const float *scale = scale_->Data();
+        const int32_t *weight_sum = weight_sum_->data();
+        for (int i = 0; i < m; i++) {
+            float *y = logits->Data() + i * logits->Stride();
+            for (int j = 0; j < n_; j++) {
+                int32_t dot = 0;
+                for (int b = 0; b < input_bits_; b++) {
+                    int plane = i * input_bits_ + b;
+                    int32_t pos = positive_count_.Data()[plane * n_ + j];
+                    int32_t neg = IsTernary() ? 
+                        negative_count_.Data()[plane * n_ + j] : 
+                        x_count_[plane] - pos;
+                    dot += (pos - neg) * (1 << b); // << of a negative is UB
+                }
+                y[j] = scale[j] * (x_scale_[i] * dot + 
+                                   x_offset_[i] * weight_sum[j]) + 
+                       (has_bias_ ? bias_->Data()[j] : 0);
+            }
+        }
+        Activate(activation_, logits);
+    }
+    if (head_.GetMode() != OutputHeadParameter::NONE) {
+        head_.Forward(*logits, out);
+    }
+}
+
+void SparseFullyConnect::FromProtoFunc(const NodeProto &proto) {
+    CHECK(proto.has_sparse_fully_connect_param());
+    const SparseFullyConnectParameter &param = 
+        proto.sparse_fully_connect_param();
+    Matrix<float> *table = new Matrix<float>();
+    table->FromProto(param.table());
+    table_.reset(table);
+    combiner_ = param.combiner();
+    has_bias_ = false;
+    bias_.reset();
+    if (param.has_bias()) { 
+        Vector<float> *bias = new Vector<float>();
+        bias->FromProto(param.bias());
+        bias_.reset(bias);
+        has_bias_ = true;
+    }
+}
+
+void SparseFullyConnect::ToProtoFunc(NodeProto *proto) const {
+    SparseFullyConnectParameter *param = 
+        proto->mutable_sparse_fully_connect_param();
+    table_->ToProto(param->mutable_table());
+    if (combiner_ != SparseFullyConnectParameter::SUM) {
+        param->set_combiner(combiner_);
+    }
+    if (has_bias_) {
+        bias_->ToProto(param->mutable_bias());
+    }
+}
+
+bool SparseFullyConnect::FuseActivation(ActivationType act) {
+    if (activation_ != ACTIVATION_NONE) return false;
+    activation_ = act;
+    return true;
+}
+
+float SparseFullyConnect::CombinerScale(const float *value, 
+        int n) const {
+    double sum = 0;
+    switch (combiner_) {
+        case SparseFullyConnectParameter::MEAN:
+            for (int i = 0; i < n; i++) sum += value[i];
+            return sum != 0 ? 1 / sum : 0;
+        case SparseFullyConnectParameter::SQRTN:
+            for (int i = 0; i < n; i++) sum += value[i] * value[i];
+            return sum > 0 ? 1 / sqrt(sum) : 0;
+        default:
+            return 1;
+    }
+}
+
+void SparseFullyConnect::Forward(const SparseMatrix &in, 
+        Matrix<float> *out) {
+    CHECK(out != nullptr);
+    CHECK(in.NumCols() == table_->NumRows());
+    const Kernels &kernels = GetKernels();
+    int n = table_->NumCols();
+    out->Resize(in.NumRows(), n);
+    const int32_t *index = in.Index();
+    const float *value = in.Value();
+    for (int r = 0; r < in.NumRows(); r++) {
+        float *y = out->Data() + r * out->Stride();
+        if (has_bias_) {
+            memcpy(y, bias_->Data(), sizeof(float) * n);
+        } else {
+            memset(y, 0, sizeof(float) * n);
+        }
+        int64_t begin = in.RowBegin(r), end = in.RowEnd(r);
+        float scale = CombinerScale(value + begin, end - begin);
+        for (int64_t i = begin; i < end; i++) {
+            // The table rows are random reads, fetch all the cache lines
+            // of the next one early
+            if (i + 1 < end) {
+                const float *next = table_->Data() + 
+                    static_cast<int64_t>(index[i + 1]) * table_->Stride();
+                for (int j = 0; j < n; j += 64 / sizeof(float)) {
+                    __builtin_prefetch(next + j);
+                }
+            }
+            kernels.axpy(scale * value[i], table_->Data() + 
+                static_cast<int64_t>(index[i]) * table_->Stride(), n, y);
+        }
+    }
+    Activate(activation_, out);
+}
+
+void SparseFullyConnect::Forward(const Matrix<float> &in, 
+        Matrix<float> *out) {
+    CHECK(out != nullptr);
+    out->Resize(in.NumRows(), table_->NumCols());
+    out->Mul(in, *table_, false);
+    for (int r = 0; r < in.NumRows(); r++) {
+        float scale = CombinerScale(in.Data() + r * in.Stride(), 
+                                    in.NumCols());
+        float *y = out->Data() + r * out->Stride();
+        for (int j = 0; j < out->NumCols(); j++) y[j] *= scale;
+    }
     if (has_bias_) {
-        out->AddVec(bias_);
+        out->AddVec(*bias_);
     }
+    Activate(activation_, out);
 }
 
 void XNet::Info() {
@@ -170,17 +1256,27 @@ void XNet::Info() {
 void XNet::ClearNodes() {
     for (int i = 0; i < nodes_.size(); i++) 
         delete nodes_[i];
+    nodes_.clear();
+    for (int i = 0; i < forward_buf_.size(); i++) 
+        delete forward_buf_[i];
+    forward_buf_.clear();
 }
 
-void XNet::FromProto(std::string proto_file) {
-    NetProto net_proto;
+bool XNet::ReadProto(const std::string &proto_file, NetProto *net_proto) {
     std::fstream in(proto_file, std::ios::in | std::ios::binary);
-    if (!in) {
-        ERROR("file %s does not exist", proto_file.c_str());
-    } else {
-        net_proto.ParseFromIstream(&in);
+    return in && net_proto->ParseFromIstream(&in);
+}
+
+void XNet::FromProto(std::string proto_file, bool optimize) {
+    NetProto net_proto;
+    if (!ReadProto(proto_file, &net_proto)) {
+        ERROR("file %s does not exist or is not a valid net", 
+              proto_file.c_str());
     }
+    FromProto(net_proto, optimize);
+}
 
+void XNet::FromProto(const NetProto &net_proto, bool optimize) {
     this->ClearNodes();
     for (int i = 0; i < net_proto.nodes_size(); i++) {
         const NodeProto &node_proto = net_proto.nodes(i);
@@ -205,50 +1301,431 @@ void XNet::FromProto(std::string proto_file) {
             case NodeProto::SOFTMAX:
                 node = new Softmax();
                 break;
+            case NodeProto::BATCH_NORM:
+                node = new BatchNorm();
+                break;
+            case NodeProto::SCALE:
+                node = new Scale();
+                break;
+            case NodeProto::IDENTITY:
+                node = new Identity();
+                break;
+            case NodeProto::PALETTE_FULLY_CONNECT:
+                node = new PaletteFullyConnect();
+                break;
+            case NodeProto::QUANTIZE_FULLY_CONNECT_16:
+                node = new QuantizeFullyConnect16();
+                break;
+            case NodeProto::SPARSE_FULLY_CONNECT:
+                node = new SparseFullyConnect();
+                break;
+            case NodeProto::BINARY_FULLY_CONNECT:
+            case NodeProto::TERNARY_FULLY_CONNECT:
+                node = new BinaryFullyConnect(node_proto.node_type());
+                break;
             default:
                 ERROR("unknown node type %d", node_proto.node_type());
         }
         node->FromProto(node_proto);
         nodes_.push_back(node);
     }
+    if (optimize) {
+        PassManager passes;
+        passes.AddDefaultPasses();
+        Optimize(passes);
+    } else {
+        FuseActivations();
+    }
 }
 
-void XNet::ToProto(std::string proto_file) const {
-    NetProto net_proto;
+int XNet::Optimize(const PassManager &passes) {
+    int num_rewrites = passes.Run(&nodes_);
+    FuseActivations();
+    return num_rewrites;
+}
+
+void XNet::FuseActivations() {
+    std::vector<Node *> nodes;
     for (int i = 0; i < nodes_.size(); i++) {
-        nodes_[i]->ToProto(net_proto.add_nodes());  
+        ActivationType act = Node::NodeTypeToActivation(nodes_[i]->Type());
+        // The name of a fused activation node is kept by the node fusing it
+        if (act != ACTIVATION_NONE && !nodes.empty() &&
+            nodes.back()->FuseActivation(act)) {
+            nodes.back()->SetActivationName(nodes_[i]->Name());
+            delete nodes_[i];
+        } else {
+            nodes.push_back(nodes_[i]);
+        }
+    }
+    nodes_.swap(nodes);
+    tuned_kernels_.clear();
+}
+
+void XNet::ToProto(NetProto *net_proto) const {
+    CHECK(net_proto != nullptr);
+    net_proto->Clear();
+    for (int i = 0; i < nodes_.size(); i++) {
+        nodes_[i]->ToProto(net_proto->add_nodes());  
+        ActivationType act = nodes_[i]->FusedActivation();
+        if (act != ACTIVATION_NONE) {
+            NodeProto *act_proto = net_proto->add_nodes();
+            const std::string &name = nodes_[i]->ActivationName();
+            if (!name.empty()) act_proto->set_name(name);
+            act_proto->set_node_type(Node::ActivationToNodeType(act));
+        }
     }
+}
+
+void XNet::ToProto(std::string proto_file) const {
+    NetProto net_proto;
+    ToProto(&net_proto);
     std::fstream output(proto_file, std::ios::out | std::ios::binary);
     if (!net_proto.SerializeToOstream(&output)) {
         ERROR("failed to write %s", proto_file.c_str());
     }
 }
 
-void XNet::Quantize(XNet *quantize_net) const {
+void XNet::Copy(XNet *net) const {
+    CHECK(net != this);
+    net->ClearNodes();
+    for (int i = 0; i < nodes_.size(); i++) {
+        net->AddNode(nodes_[i]->Copy());
+    }
+    net->tuned_kernels_ = tuned_kernels_;
+}
+
+void XNet::Slice(int begin, int end, XNet *net) const {
+    CHECK(net != this);
+    CHECK(begin >= 0 && begin < end && end <= nodes_.size());
+    net->ClearNodes();
+    for (int i = begin; i < end; i++) {
+        net->AddNode(nodes_[i]->Copy());
+    }
+    net->tuned_kernels_.clear();
+    for (int b = 0; b < tuned_kernels_.size(); b++) {
+        net->tuned_kernels_.push_back(std::vector<KernelConfig>(
+            tuned_kernels_[b].begin() + begin, 
+            tuned_kernels_[b].begin() + end));
+    }
+}
+
+void XNet::Quantize(XNet *quantize_net, int bits) const {
+    std::vector<bool> quantize_mask(nodes_.size(), true);
+    Quantize(quantize_mask, quantize_net, bits);
+}
+
+void XNet::Quantize(const std::vector<bool> &quantize_mask, 
+        XNet *quantize_net, int bits) const {
+    CHECK(quantize_mask.size() == nodes_.size());
     quantize_net->ClearNodes(); 
     for (int i = 0; i < nodes_.size(); i++) {
-        quantize_net->AddNode(nodes_[i]->Quantize());
+        quantize_net->AddNode(quantize_mask[i] ? nodes_[i]->Quantize(bits) : 
+                                                 nodes_[i]->Copy());
     }
 }
 
-void XNet::Forward(const Matrix<float> &in, Matrix<float> *out) {
-    CHECK(out != nullptr);
+void XNet::Binarize(const std::vector<bool> &mask, bool ternary, 
+        int input_bits, XNet *net) const {
+    CHECK(mask.size() == nodes_.size());
+    net->ClearNodes();
+    for (int i = 0; i < nodes_.size(); i++) {
+        if (mask[i] && nodes_[i]->Type() == NodeProto::FULLY_CONNECT) {
+            const FullyConnect *fc = 
+                static_cast<const FullyConnect *>(nodes_[i]);
+            net->AddNode(fc->Binarize(ternary, input_bits));
+        } else {
+            net->AddNode(nodes_[i]->Copy());
+        }
+    }
+}
+
+void XNet::Palettize(int codebook_size, int num_iters, XNet *net, 
+        std::vector<float> *mse) const {
+    net->ClearNodes();
+    if (mse != nullptr) mse->assign(nodes_.size(), 0);
+    for (int i = 0; i < nodes_.size(); i++) {
+        if (nodes_[i]->Type() == NodeProto::FULLY_CONNECT) {
+            const FullyConnect *fc = 
+                static_cast<const FullyConnect *>(nodes_[i]);
+            net->AddNode(fc->Palettize(codebook_size, num_iters, 
+                mse != nullptr ? &(*mse)[i] : nullptr));
+        } else {
+            net->AddNode(nodes_[i]->Copy());
+        }
+    }
+}
+
+void XNet::ForwardNode(int i, const Matrix<float> &in, Matrix<float> *out) {
+    if (profiler_ == nullptr) {
+        nodes_[i]->Forward(in, out);
+        return;
+    }
+    Node *node = nodes_[i];
+    std::string name = std::to_string(i) + " " + 
+        (node->Name().empty() ? Node::NodeTypeToString(node->Type()) : 
+         node->Name());
+    Profiler::SetCurrent(profiler_);
+    profiler_->BeginNode(i, name);
+    node->Forward(in, out);
+    profiler_->EndNode(node->Flops(in), 
+        sizeof(float) * in.Size() + node->WeightBytes(), 
+        sizeof(float) * out->Size());
+    Profiler::SetCurrent(nullptr);
+}
+
+void XNet::PrepareForward(int batch) {
     CHECK(nodes_.size() > 0);
+    if (!tuned_kernels_.empty()) {
+        const std::vector<KernelConfig> &kernels = 
+            tuned_kernels_[BatchBucket(batch)];
+        for (int i = 0; i < nodes_.size(); i++) {
+            nodes_[i]->SetKernel(kernels[i]);
+        }
+    }
     int num_layers = nodes_.size();
-    if (forward_buf_.size() != num_layers) {
-        for (int i = 0; i < num_layers - 1; i++) {
+    if (forward_buf_.size() != num_layers - 1) {
+        for (int i = forward_buf_.size(); i < num_layers - 1; i++) {
             forward_buf_.push_back(new Matrix<float>()); 
         }
     }
-    if (nodes_.size() == 1) {
-        nodes_[0]->Forward(in, out);
+}
+
+void XNet::ForwardNodes(int begin, const Matrix<float> &in, 
+        Matrix<float> *out) {
+    int num_layers = nodes_.size();
+    if (begin == num_layers - 1) {
+        ForwardNode(begin, in, out);
     }
     else {
-        nodes_[0]->Forward(in, forward_buf_[0]);
-        for (int i = 1; i < nodes_.size() - 1; i++) {
-            nodes_[i]->Forward(*(forward_buf_[i-1]), forward_buf_[i]);
+        ForwardNode(begin, in, forward_buf_[begin]);
+        for (int i = begin + 1; i < nodes_.size() - 1; i++) {
+            ForwardNode(i, *(forward_buf_[i-1]), forward_buf_[i]);
+        }
+        ForwardNode(num_layers-1, *(forward_buf_[num_layers-2]), out);
+    }
+}
+
+void XNet::Forward(const Matrix<float> &in, Matrix<float> *out) {
+    CHECK(out != nullptr);
+    if (cache_ != nullptr) {
+        ForwardCached(in, out);
+        return;
+    }
+    PrepareForward(in.NumRows());
+    ForwardNodes(0, in, out);
+}
+
+void XNet::SetResultCache(ResultCache *cache, uint64_t tag) {
+    if (cache != nullptr && BatchDependent()) {
+        ERROR("the output of a row depends on its batch, the net can not "
+              "use a result cache");
+    }
+    cache_ = cache;
+    cache_tag_ = tag;
+}
+
+bool XNet::BatchDependent() const {
+    for (int i = 0; i < nodes_.size(); i++) {
+        if (nodes_[i]->BatchDependent()) return true;
+    }
+    return false;
+}
+
+void XNet::ForwardCached(const Matrix<float> &in, Matrix<float> *out) {
+    int in_dim = in.NumCols(), out_dim = OutputDim(in_dim);
+    out->Resize(in.NumRows(), out_dim);
+    miss_rows_.clear();
+    for (int i = 0; i < in.NumRows(); i++) {
+        if (!cache_->Lookup(in.Data() + i * in.Stride(), in_dim, 
+                            out->Data() + i * out->Stride(), out_dim, 
+                            cache_tag_)) {
+            miss_rows_.push_back(i);
+        }
+    }
+    if (miss_rows_.empty()) return;
+    int num_misses = miss_rows_.size();
+    miss_in_.Resize(num_misses, in_dim);
+    for (int k = 0; k < num_misses; k++) {
+        memcpy(miss_in_.Data() + k * miss_in_.Stride(), 
+               in.Data() + miss_rows_[k] * in.Stride(), 
+               sizeof(float) * in_dim);
+    }
+    PrepareForward(num_misses);
+    ForwardNodes(0, miss_in_, &miss_out_);
+    CHECK(miss_out_.NumCols() == out_dim);
+    for (int k = 0; k < num_misses; k++) {
+        const float *y = miss_out_.Data() + k * miss_out_.Stride();
+        memcpy(out->Data() + miss_rows_[k] * out->Stride(), y, 
+               sizeof(float) * out_dim);
+        cache_->Insert(miss_in_.Data() + k * miss_in_.Stride(), in_dim, 
+                       y, out_dim, cache_tag_);
+    }
+}
+
+void XNet::Forward(const SparseMatrix &in, Matrix<float> *out) {
+    CHECK(out != nullptr);
+    PrepareForward(in.NumRows());
+    if (nodes_[0]->Type() != NodeProto::SPARSE_FULLY_CONNECT) {
+        ERROR("the first node %s can not take a sparse input", 
+              Node::NodeTypeToString(nodes_[0]->Type()).c_str());
+    }
+    SparseFullyConnect *node = static_cast<SparseFullyConnect *>(nodes_[0]);
+    Matrix<float> *first_out = nodes_.size() == 1 ? out : forward_buf_[0];
+    if (profiler_ == nullptr) {
+        node->Forward(in, first_out);
+    } else {
+        std::string name = "0 " + (node->Name().empty() ? 
+            Node::NodeTypeToString(node->Type()) : node->Name());
+        Profiler::SetCurrent(profiler_);
+        profiler_->BeginNode(0, name);
+        node->Forward(in, first_out);
+        // The rows of the table gathered
+        profiler_->EndNode(node->Flops(in), 
+            (sizeof(float) + sizeof(int32_t)) * in.NumNonZeros() + 
+            sizeof(float) * in.NumNonZeros() * first_out->NumCols(),
+            sizeof(float) * first_out->Size());
+        Profiler::SetCurrent(nullptr);
+    }
+    if (nodes_.size() > 1) ForwardNodes(1, *first_out, out);
+}
+
+void XNet::Forward(const float *in, int rows, int cols, int in_stride, 
+        float *out, int out_stride) {
+    Matrix<float> in_view(const_cast<float *>(in), rows, cols, in_stride);
+    Matrix<float> out_view(out, rows, OutputDim(cols), out_stride);
+    Forward(in_view, &out_view);
+}
+
+bool XNet::CheckDims(int input_dim, std::string *error) const {
+    CHECK(error != nullptr);
+    if (nodes_.empty()) {
+        *error = "no node";
+        return false;
+    }
+    int dim = input_dim;
+    for (int i = 0; i < nodes_.size(); i++) {
+        int node_dim = nodes_[i]->InputDim();
+        if (node_dim > 0 && node_dim != dim) {
+            *error = "node " + std::to_string(i) + " " + 
+                Node::NodeTypeToString(nodes_[i]->Type()) + " takes dim " + 
+                std::to_string(node_dim) + ", but gets " + 
+                std::to_string(dim);
+            return false;
+        }
+        dim = nodes_[i]->OutputDim(dim);
+    }
+    return true;
+}
+
+int XNet::OutputDim(int input_dim) const {
+    int dim = input_dim;
+    for (int i = 0; i < nodes_.size(); i++) {
+        dim = nodes_[i]->OutputDim(dim);
+    }
+    return dim;
+}
+
+void XNet::SetOutputHead(const OutputHead &head) {
+    CHECK(nodes_.size() > 0);
+    Node *node = nodes_.back();
+    if (!node->SetOutputHead(head)) {
+        ERROR("the last node %s can not have an output head", 
+              Node::NodeTypeToString(node->Type()).c_str());
+    }
+}
+
+std::string XNet::Signature() const {
+    // FNV-1a of node types and weight sizes
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < nodes_.size(); i++) {
+        std::string key = std::to_string(nodes_[i]->Type()) + ":" + 
+            std::to_string(nodes_[i]->WeightBytes()) + ";";
+        for (int j = 0; j < key.size(); j++) {
+            hash = (hash ^ static_cast<uint8_t>(key[j])) * 1099511628211ULL;
         }
-        nodes_[num_layers-1]->Forward(*(forward_buf_[num_layers-2]), out);
     }
+    char signature[32];
+    snprintf(signature, sizeof(signature), "%d-%016llx", 
+             static_cast<int>(nodes_.size()), 
+             static_cast<unsigned long long>(hash));
+    return signature;
 }
 
+void XNet::SetTuneTable(const TuneTable &table, bool set_blas_threads) {
+    if (table.Signature() != Signature()) {
+        ERROR("tune table signature %s does not match the net %s", 
+              table.Signature().c_str(), Signature().c_str());
+    }
+    tuned_kernels_.assign(kNumBatchBuckets, 
+                          std::vector<KernelConfig>(nodes_.size()));
+    int blas_threads = 0;
+    for (int bucket = 0; bucket < kNumBatchBuckets; bucket++) {
+        for (int i = 0; i < nodes_.size(); i++) {
+            // Untuned buckets use the nearest smaller tuned bucket
+            KernelConfig config;
+            for (int b = bucket; b >= 0; b--) {
+                if (table.Get(i, b, &config)) break;
+            }
+            tuned_kernels_[bucket][i] = config;
+            nodes_[i]->PrepareKernel(config);
+            if (config.kernel == KERNEL_BLAS || 
+                config.kernel == KERNEL_FLOAT) {
+                blas_threads = std::max(blas_threads, config.num_threads);
+            }
+        }
+    }
+    if (set_blas_threads) SetBlasNumThreads(blas_threads);
+}
+
+void XNet::Tune(int input_dim, int max_batch, TuneTable *table) {
+    CHECK(table != nullptr);
+    CHECK(nodes_.size() > 0);
+    const int num_runs = 10;
+    *table = TuneTable(Signature());
+    std::mt19937 generator(777);
+    std::uniform_real_distribution<float> distribution(-1.0, 1.0);
+    for (int bucket = 0; bucket <= BatchBucket(max_batch); bucket++) {
+        Matrix<float> in(BucketBatch(bucket), input_dim), out;
+        for (int i = 0; i < in.Size(); i++) {
+            in.Data()[i] = distribution(generator);
+        }
+        // Tune node by node, the input of a node is the output of the 
+        // tuned previous nodes
+        for (int i = 0; i < nodes_.size(); i++) {
+            std::vector<KernelConfig> kernels = nodes_[i]->KernelConfigs();
+            KernelConfig best = kernels[0];
+            double best_time = -1;
+            for (int k = 0; kernels.size() > 1 && k < kernels.size(); k++) {
+                nodes_[i]->SetKernel(kernels[k]);
+                // Forward does not set the blas threads, see SetTuneTable
+                if (kernels[k].kernel == KERNEL_BLAS || 
+                    kernels[k].kernel == KERNEL_FLOAT) {
+                    SetBlasNumThreads(kernels[k].num_threads);
+                }
+                nodes_[i]->Forward(in, &out); // warm up
+                std::vector<double> times;
+                for (int n = 0; n < num_runs; n++) {
+                    Timer timer;
+                    nodes_[i]->Forward(in, &out);
+                    times.push_back(timer.Elapsed());
+                }
+                std::sort(times.begin(), times.end());
+                double time = times[num_runs / 2];
+                if (best_time < 0 || time < best_time) {
+                    best_time = time;
+                    best = kernels[k];
+                }
+            }
+            if (kernels.size() > 1) {
+                table->Set(i, bucket, best);
+            }
+            nodes_[i]->SetKernel(best);
+            if (best.kernel == KERNEL_BLAS || best.kernel == KERNEL_FLOAT) {
+                SetBlasNumThreads(best.num_threads);
+            }
+            nodes_[i]->Forward(in, &out);
+            in.CopyFrom(out);
+        }
+    }
+    SetTuneTable(*table);
+}
@@ -5,38 +5,128 @@
 #ifndef XNET_H_
 #define XNET_H_
 
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "utils.h"
 #include "net.pb.h"
 #include "tensor.h"
+#include "profiler.h"
+#include "tuner.h"
+#include "result-cache.h"
 
 
+// Output head of the last Softmax or (quantize) fully connect node, fused
+// into the node so the caller needs no more passes over the output:
+//   NONE, the output of the node
+//   LOG_PROB, log softmax of the logits minus the log prior if any
+//   TOP_K, indices(as float) of the k largest logits minus the log prior,
+//          the largest first. Softmax keeps the order, so it is skipped.
+class OutputHead {
+public:
+    typedef OutputHeadParameter_Mode Mode;
+    OutputHead(Mode mode = OutputHeadParameter::NONE, int k = 1): 
+        mode_(mode), k_(k) {}
+    void FromProto(const OutputHeadParameter &proto);
+    void ToProto(OutputHeadParameter *proto) const;
+    Mode GetMode() const { return mode_; }
+    // Priors of the classes, eg: state counts, log of the normalized
+    // priors is subtracted
+    void SetPrior(const Vector<float> &prior);
+    bool HasLogPrior() const { return log_prior_ != nullptr; }
+    int OutputDim(int input_dim) const {
+        return mode_ == OutputHeadParameter::TOP_K ? k_ : input_dim;
+    }
+    std::string ToString() const;
+    // LOG_PROB and TOP_K only, LOG_PROB can be in place(out is &in)
+    void Forward(const Matrix<float> &in, Matrix<float> *out);
+private:
+    void LogSoftmax(const Matrix<float> &in, Matrix<float> *out) const;
+    void TopK(const Matrix<float> &in, Matrix<float> *out);
+    Mode mode_;
+    int k_;
+    // Read only, shared by the copies
+    std::shared_ptr<const Vector<float> > log_prior_;
+    std::vector<std::pair<float, int> > heap_; // TopK buffer
+};
+
+class PassManager;
+
 class Node {
 public:
     Node(NodeProto_NodeType type=NodeProto::UNKNOWN): type_(type) {}
+    // The nodes are deleted through Node *, eg: by XNet and the passes
+    virtual ~Node() {}
     void FromProto(const NodeProto &proto) {
         CHECK(type_ == proto.node_type());
+        name_ = proto.name();
         FromProtoFunc(proto);
     }
     void ToProto(NodeProto *proto) const {
+        if (!name_.empty()) proto->set_name(name_);
         proto->set_node_type(type_);
         ToProtoFunc(proto);
     }
     virtual void Forward(const Matrix<float> &in, Matrix<float> *out) = 0;
-    virtual void Info() const {
-        std::cout << NodeTypeToString(type_) << "\n";
-    }
+    virtual void Info() const;
     static std::string NodeTypeToString(NodeProto_NodeType type);
+    // RELU/SIGMOID/TANH nodes and the ActivationType of them,
+    // other node types are ACTIVATION_NONE
+    static ActivationType NodeTypeToActivation(NodeProto_NodeType type);
+    static NodeProto_NodeType ActivationToNodeType(ActivationType act);
     virtual Node* Copy() const = 0;
-    virtual Node* Quantize() const {
+    // Quantized node of bits 8 or 16, a copy if the node has none
+    virtual Node* Quantize(int bits = 8) const {
         return this->Copy();
     }
     NodeProto_NodeType Type() const { return type_; };
+    const std::string &Name() const { return name_; }
+    void SetName(const std::string &name) { name_ = name; }
+    // Cost of one Forward on in, used by the profiler.
+    // Activations count one flop per element.
+    virtual int64_t Flops(const Matrix<float> &in) const { return in.Size(); }
+    // Output dim of the node on input of input_dim
+    virtual int OutputDim(int input_dim) const { return input_dim; }
+    // Input dim the node takes, 0 if any
+    virtual int InputDim() const { return 0; }
+    // True if the output of a row depends on the other rows of the batch
+    // (eg: one quantization range of the whole input)
+    virtual bool BatchDependent() const { return false; }
+    virtual int64_t WeightBytes() const { return 0; }
+    // Kernel configurations Forward can run with, XNet::Tune benchmarks
+    // all of them and picks the best one for every batch size bucket
+    virtual std::vector<KernelConfig> KernelConfigs() const {
+        return std::vector<KernelConfig>(1, KernelConfig());
+    }
+    void SetKernel(const KernelConfig &kernel) { 
+        PrepareKernel(kernel);
+        kernel_ = kernel; 
+    }
+    // Build the read only data Forward with kernel needs(eg: a dequantized
+    // weight), the copies made after share it. XNet::SetTuneTable does it
+    // for all the tuned kernels, so the replicas do not build their own.
+    virtual void PrepareKernel(const KernelConfig &kernel) {}
+    // Apply the activation of the next node in Forward of this node,
+    // return false if the node can not fuse it
+    virtual bool FuseActivation(ActivationType act) { return false; }
+    virtual ActivationType FusedActivation() const { return ACTIVATION_NONE; }
+    // Name of the fused activation node, ToProto writes it back
+    const std::string &ActivationName() const { return activation_name_; }
+    void SetActivationName(const std::string &name) { 
+        activation_name_ = name; 
+    }
+    // Only Softmax and (quantize) fully connect have an output head, 
+    // return false if the node can not have it
+    virtual bool SetOutputHead(const OutputHead &head) { return false; }
+    virtual const OutputHead *GetOutputHead() const { return nullptr; }
 protected:
     virtual void FromProtoFunc(const NodeProto &proto) {}
     virtual void ToProtoFunc(NodeProto *proto) const {}
     NodeProto_NodeType type_;
+    std::string name_, activation_name_;
+    KernelConfig kernel_;
 };
 
 class ReLU: public Node {
@@ -64,43 +154,411 @@ class Softmax: public Node {
 public:
     Softmax(): Node(NodeProto::SOFTMAX) {}
     Node * Copy() const { return new Softmax(*this); }
+    void FromProtoFunc(const NodeProto &proto);
+    void ToProtoFunc(NodeProto *proto) const; 
+    void Forward(const Matrix<float> &in, Matrix<float> *out);
+    int OutputDim(int input_dim) const { return head_.OutputDim(input_dim); }
+    bool SetOutputHead(const OutputHead &head) { 
+        head_ = head; 
+        return true;
+    }
+    const OutputHead *GetOutputHead() const { return &head_; }
+private:
+    OutputHead head_;
+};
+
+class Identity: public Node {
+public:
+    Identity(): Node(NodeProto::IDENTITY) {}
+    Node * Copy() const { return new Identity(*this); }
+    void Forward(const Matrix<float> &in, Matrix<float> *out);
+    int64_t Flops(const Matrix<float> &in) const { return 0; }
+};
+
+// y = scale * x + bias per dim, usually folded into the fully connect
+// before it by FoldScalePass
+class Scale: public Node {
+public:
+    Scale(): Node(NodeProto::SCALE) {}
+    Node * Copy() const { return new Scale(*this); }
+    virtual void FromProtoFunc(const NodeProto &proto);
+    virtual void ToProtoFunc(NodeProto *proto) const; 
     void Forward(const Matrix<float> &in, Matrix<float> *out);
+    int64_t Flops(const Matrix<float> &in) const { return 2 * in.Size(); }
+    int InputDim() const { return scale_->Size(); }
+    int64_t WeightBytes() const {
+        return sizeof(float) * 
+            (scale_->Size() + (bias_ != nullptr ? bias_->Size() : 0));
+    }
+    const Vector<float> &Scales() const { return *scale_; }
+    // nullptr if no bias
+    const Vector<float> *Bias() const { return bias_.get(); }
+protected:
+    Scale(NodeProto_NodeType type): Node(type) {}
+    // Read only, shared by the copies of the node
+    std::shared_ptr<const Vector<float> > scale_;
+    std::shared_ptr<const Vector<float> > bias_;
+};
+
+// Batch normalization at inference is a Scale, the parameters are kept
+// for ToProto
+class BatchNorm: public Scale {
+public:
+    BatchNorm(): Scale(NodeProto::BATCH_NORM) {}
+    Node * Copy() const { return new BatchNorm(*this); }
+    void FromProtoFunc(const NodeProto &proto);
+    void ToProtoFunc(NodeProto *proto) const; 
+private:
+    std::shared_ptr<const BatchNormParameter> param_;
 };
 
 class FullyConnect: public Node {
 public:
-    FullyConnect(): Node(NodeProto::FULLY_CONNECT), has_bias_(false) {}
+    FullyConnect(): Node(NodeProto::FULLY_CONNECT), has_bias_(false), 
+                    activation_(ACTIVATION_NONE) {}
     Node * Copy() const { return new FullyConnect(*this); }
     virtual void FromProtoFunc(const NodeProto &proto);
     void ToProtoFunc(NodeProto *proto) const; 
-    virtual Node* Quantize() const; 
+    virtual Node* Quantize(int bits = 8) const; 
+    // A BinaryFullyConnect of the weight, binary or ternary
+    Node* Binarize(bool ternary, int input_bits) const;
+    // A PaletteFullyConnect of the k-means codebook of the weight, mse
+    // gets the mean squared error of the weight if not nullptr
+    Node* Palettize(int codebook_size, int num_iters, 
+                    float *mse = nullptr) const;
     void Forward(const Matrix<float> &in, Matrix<float> *out);
+    int64_t Flops(const Matrix<float> &in) const {
+        return 2LL * in.NumRows() * weight_->NumRows() * weight_->NumCols();
+    }
+    int OutputDim(int input_dim) const { 
+        return head_.OutputDim(weight_->NumRows()); 
+    }
+    int InputDim() const { return weight_->NumCols(); }
+    int64_t WeightBytes() const {
+        return sizeof(float) * (weight_->Size() + (has_bias_ ? bias_->Size() : 0));
+    }
+    std::vector<KernelConfig> KernelConfigs() const;
+    // A node has either a fused activation or an output head
+    bool FuseActivation(ActivationType act);
+    ActivationType FusedActivation() const { return activation_; }
+    bool SetOutputHead(const OutputHead &head);
+    const OutputHead *GetOutputHead() const { return &head_; }
+    // Batch up to it runs the gemv kernel by default, it streams the 
+    // weight once for all the rows with bias and activation fused
+    static const int kGemvBatch = 4;
+    const Matrix<float> &Weight() const { return *weight_; }
+    // nullptr if no bias
+    const Vector<float> *Bias() const { 
+        return has_bias_ ? bias_.get() : nullptr; 
+    }
+    // Replace the weight or bias, eg: by the graph passes
+    void SetWeight(Matrix<float> weight) { 
+        weight_.reset(new Matrix<float>(std::move(weight)));
+    }
+    void SetBias(Vector<float> bias) { 
+        bias_.reset(new Vector<float>(std::move(bias)));
+        has_bias_ = true;
+    }
 private:
-    Matrix<float> weight_;
-    Vector<float> bias_;
+    // Read only, shared by the copies of the node
+    std::shared_ptr<const Matrix<float> > weight_;
+    std::shared_ptr<const Vector<float> > bias_;
     bool has_bias_;
+    ActivationType activation_;
+    OutputHead head_;
+    Matrix<float> logits_; // TOP_K head only
 };
 
 class QuantizeFullyConnect: public Node {
 public:
-    QuantizeFullyConnect(): Node(NodeProto::QUANTIZE_FULLY_CONNECT) {}
+    QuantizeFullyConnect(): Node(NodeProto::QUANTIZE_FULLY_CONNECT), 
+                            activation_(ACTIVATION_NONE) {}
     Node * Copy() const { return new QuantizeFullyConnect(*this); }
     virtual void FromProtoFunc(const NodeProto &proto);
     void ToProtoFunc(NodeProto *proto) const; 
-    void SetWeight(const Matrix<uint8_t> &weight) { weight_.CopyFrom(weight); }
-    void SetBias(const Vector<float> &bias) { bias_.CopyFrom(bias); }
-    void SetWeightScale(float scale) { w_scale_ = scale; };
-    void SetWeightZeroPoint(uint8_t zero_point) { w_zero_point_ = zero_point; }
+    void SetWeight(Matrix<uint8_t> weight) { 
+        weight_.reset(new Matrix<uint8_t>(std::move(weight)));
+        float_weight_.reset();
+        PackWeight();
+    }
+    void SetBias(const std::shared_ptr<const Vector<float> > &bias) { 
+        bias_ = bias; 
+    }
+    void SetWeightScale(float scale) { 
+        w_scale_ = scale; 
+        float_weight_.reset();
+    }
+    void SetWeightZeroPoint(uint8_t zero_point) { 
+        w_zero_point_ = zero_point; 
+        float_weight_.reset();
+    }
     void SetHasBias(bool has_bias) { has_bias_ = has_bias; }
+    bool FuseActivation(ActivationType act);
+    ActivationType FusedActivation() const { return activation_; }
+    bool SetOutputHead(const OutputHead &head);
+    const OutputHead *GetOutputHead() const { return &head_; }
     void Forward(const Matrix<float> &in, Matrix<float> *out);
+    int64_t Flops(const Matrix<float> &in) const {
+        return 2LL * in.NumRows() * weight_->NumRows() * weight_->NumCols();
+    }
+    int OutputDim(int input_dim) const { 
+        return head_.OutputDim(weight_->NumRows()); 
+    }
+    int InputDim() const { return weight_->NumCols(); }
+    // The input is quantized with one scale and zero point per batch
+    bool BatchDependent() const { return true; }
+    int64_t WeightBytes() const {
+        return weight_->Size() + sizeof(float) * (has_bias_ ? bias_->Size() : 0);
+    }
+    std::vector<KernelConfig> KernelConfigs() const;
+    void PrepareKernel(const KernelConfig &kernel);
+    // Batch up to it runs the packed small batch int8 kernel by default
+    static const int kSmallBatch = 8;
 private:
-    Matrix<uint8_t> weight_;
-    Vector<float> bias_;
+    // KERNEL_FLOAT, dequantized weight and float gemm
+    void ForwardFloat(const Matrix<float> &in, Matrix<float> *out);
+    // The default, quantized input and uint8 gemm
+    void ForwardInt8(const Matrix<float> &in, Matrix<float> *out);
+    // Pack the weight for the small batch kernel if the cpu has one
+    void PackWeight();
+    // Read only, shared by the copies of the node
+    std::shared_ptr<const Matrix<uint8_t> > weight_;
+    std::shared_ptr<const Vector<float> > bias_;
     float w_scale_;
     uint8_t w_zero_point_;
     bool has_bias_;
+    ActivationType activation_;
+    OutputHead head_;
+    Matrix<float> logits_; // TOP_K head only
     Matrix<int32_t> quantize_out_;
     Matrix<uint8_t> quantize_in_;
+    // Built from weight_ by PrepareKernel, shared by the copies made after
+    std::shared_ptr<const Matrix<float> > float_weight_; // KERNEL_FLOAT only
+    std::shared_ptr<const PackedU8Weight> packed_weight_;
+};
+
+// Fully connect of int16 weight and input, both symmetric(zero point 0)
+// in [-kS16Max, kS16Max], the input is quantized per row. Close to float
+// accuracy for layers where uint8 costs too much, half the weight bytes.
+class QuantizeFullyConnect16: public Node {
+public:
+    QuantizeFullyConnect16(): Node(NodeProto::QUANTIZE_FULLY_CONNECT_16), 
+                              w_scale_(0), has_bias_(false), 
+                              activation_(ACTIVATION_NONE) {}
+    Node * Copy() const { return new QuantizeFullyConnect16(*this); }
+    void FromProtoFunc(const NodeProto &proto);
+    void ToProtoFunc(NodeProto *proto) const; 
+    // Quantize the float weight
+    void SetWeight(const Matrix<float> &weight);
+    void SetBias(const std::shared_ptr<const Vector<float> > &bias) { 
+        bias_ = bias; 
+        has_bias_ = bias != nullptr;
+    }
+    bool FuseActivation(ActivationType act);
+    ActivationType FusedActivation() const { return activation_; }
+    bool SetOutputHead(const OutputHead &head);
+    const OutputHead *GetOutputHead() const { return &head_; }
+    void Forward(const Matrix<float> &in, Matrix<float> *out);
+    int64_t Flops(const Matrix<float> &in) const {
+        return 2LL * in.NumRows() * weight_->NumRows() * weight_->NumCols();
+    }
+    int OutputDim(int input_dim) const { 
+        return head_.OutputDim(weight_->NumRows()); 
+    }
+    int InputDim() const { return weight_->NumCols(); }
+    int64_t WeightBytes() const {
+        return sizeof(int16_t) * weight_->Size() + 
+               sizeof(float) * (has_bias_ ? bias_->Size() : 0);
+    }
+private:
+    // Read only, shared by the copies of the node
+    std::shared_ptr<const Matrix<int16_t> > weight_;
+    float w_scale_;
+    std::shared_ptr<const Vector<float> > bias_;
+    bool has_bias_;
+    ActivationType activation_;
+    OutputHead head_;
+    Matrix<float> logits_; // TOP_K head only
+    Matrix<int16_t> quantize_in_;
+    std::vector<float> in_scale_; // per row
+};
+
+// Fully connect of a palettized weight, w[j][p] = codebook[index[j][p]],
+// the codebook(eg: k-means centers of the float weight) has 2~256
+// entries. Small batches look up the codebook in registers and never
+// build the float weight, larger ones decode it once and run float gemm.
+class PaletteFullyConnect: public Node {
+public:
+    PaletteFullyConnect(): Node(NodeProto::PALETTE_FULLY_CONNECT), 
+                           codebook_size_(0), has_bias_(false),
+                           activation_(ACTIVATION_NONE) {}
+    Node * Copy() const { return new PaletteFullyConnect(*this); }
+    void FromProtoFunc(const NodeProto &proto);
+    void ToProtoFunc(NodeProto *proto) const; 
+    // index is n x k, every index < codebook.Size()
+    void SetPalette(const Vector<float> &codebook, Matrix<uint8_t> index);
+    void SetBias(const std::shared_ptr<const Vector<float> > &bias) { 
+        bias_ = bias; 
+        has_bias_ = bias != nullptr;
+    }
+    bool FuseActivation(ActivationType act);
+    ActivationType FusedActivation() const { return activation_; }
+    bool SetOutputHead(const OutputHead &head);
+    const OutputHead *GetOutputHead() const { return &head_; }
+    void Forward(const Matrix<float> &in, Matrix<float> *out);
+    int64_t Flops(const Matrix<float> &in) const {
+        return 2LL * in.NumRows() * index_->NumRows() * index_->NumCols();
+    }
+    int OutputDim(int input_dim) const { 
+        return head_.OutputDim(index_->NumRows()); 
+    }
+    int InputDim() const { return index_->NumCols(); }
+    // Bytes of the weight in memory, one byte per index
+    int64_t WeightBytes() const {
+        return index_->Size() + sizeof(float) * 
+            (codebook_size_ + (has_bias_ ? bias_->Size() : 0));
+    }
+    std::vector<KernelConfig> KernelConfigs() const;
+    int CodebookSize() const { return codebook_size_; }
+    // Batch up to it runs the lookup kernel by default
+    static const int kGemvBatch = 4;
+private:
+    // KERNEL_FLOAT, the weight is decoded a tile of rows at a time into
+    // float_tile_ and multiplied by float gemm, so the float weight is 
+    // never kept whole
+    void ForwardFloat(const Matrix<float> &in, Matrix<float> *out);
+    // Floats of a decoded tile, it fits the L2 cache
+    static const int kFloatTileSize = 64 * 1024;
+    // Read only, shared by the copies of the node
+    std::shared_ptr<const Vector<float> > codebook_; // zero padded to 256
+    int codebook_size_;
+    std::shared_ptr<const Matrix<uint8_t> > index_;
+    std::shared_ptr<const Vector<float> > bias_;
+    bool has_bias_;
+    ActivationType activation_;
+    OutputHead head_;
+    Matrix<float> logits_; // TOP_K head only
+    Matrix<float> float_tile_; // KERNEL_FLOAT only, per copy
+};
+
+// Fully connect of a {-1, +1}(BINARY_FULLY_CONNECT) or {-1, 0, +1}
+// (TERNARY_FULLY_CONNECT) weight times a per row scale, the weight is
+// bit packed, a bit plane of +1s and a plane of -1s for ternary.
+// Every input row is quantized to input_bits bit planes, x = scale * q +
+// offset, so a dot product is popcounts of (plane of x & plane of w):
+//   w * q = sum_b 2^b * (|pos & q_b| - |neg & q_b|)
+// binary has no neg plane, |neg & q_b| = |q_b| - |pos & q_b|.
+// input_bits 1 is the sign of x times the mean of |x|(xnor net).
+class BinaryFullyConnect: public Node {
+public:
+    explicit BinaryFullyConnect(
+            NodeProto_NodeType type = NodeProto::BINARY_FULLY_CONNECT): 
+        Node(type), n_(0), k_(0), words_(0), input_bits_(4), 
+        has_bias_(false), activation_(ACTIVATION_NONE) {
+        CHECK(type == NodeProto::BINARY_FULLY_CONNECT || 
+              type == NodeProto::TERNARY_FULLY_CONNECT);
+    }
+    Node * Copy() const { return new BinaryFullyConnect(*this); }
+    void FromProtoFunc(const NodeProto &proto);
+    void ToProtoFunc(NodeProto *proto) const; 
+    // Binarize(sign) or ternarize the float weight, ternary drops the 
+    // weights under 0.7 * mean(|w|) of the row. The scale of a row is
+    // the mean |w| of its nonzero weights.
+    void SetWeight(const Matrix<float> &weight);
+    void SetBias(const std::shared_ptr<const Vector<float> > &bias) { 
+        bias_ = bias; 
+        has_bias_ = bias != nullptr;
+    }
+    void SetInputBits(int input_bits) { 
+        CHECK(input_bits >= 1 && input_bits <= 8);
+        input_bits_ = input_bits; 
+    }
+    bool FuseActivation(ActivationType act);
+    ActivationType FusedActivation() const { return activation_; }
+    bool SetOutputHead(const OutputHead &head);
+    const OutputHead *GetOutputHead() const { return &head_; }
+    void Forward(const Matrix<float> &in, Matrix<float> *out);
+    int64_t Flops(const Matrix<float> &in) const {
+        return 2LL * in.NumRows() * n_ * k_;
+    }
+    int OutputDim(int input_dim) const { return head_.OutputDim(n_); }
+    int InputDim() const { return k_; }
+    int64_t WeightBytes() const {
+        return sizeof(uint64_t) * (positive_->size() + 
+            (negative_ != nullptr ? negative_->size() : 0)) + 
+            sizeof(float) * (n_ + (has_bias_ ? bias_->Size() : 0));
+    }
+private:
+    bool IsTernary() const { 
+        return type_ == NodeProto::TERNARY_FULLY_CONNECT; 
+    }
+    // Weight sums of the rows from the planes
+    void ComputeWeightSum();
+    // Quantize the rows of in to the bit planes of x_bits_
+    void QuantizeInput(const Matrix<float> &in);
+    int n_, k_, words_, input_bits_;
+    // Read only, shared by the copies of the node
+    std::shared_ptr<const std::vector<uint64_t> > positive_, negative_;
+    std::shared_ptr<const Vector<float> > scale_;
+    std::shared_ptr<const std::vector<int32_t> > weight_sum_;
+    std::shared_ptr<const Vector<float> > bias_;
+    bool has_bias_;
+    ActivationType activation_;
+    OutputHead head_;
+    Matrix<float> logits_; // TOP_K head only
+    // Bit planes of the input, [row][bit][word], and per row scale/offset
+    std::vector<uint64_t> x_bits_;
+    std::vector<int32_t> x_count_; // popcount of every plane, binary only
+    std::vector<float> x_scale_, x_offset_;
+    Matrix<int32_t> positive_count_, negative_count_;
+};
+
+// Fully connect on a sparse input(XNet::Forward of a SparseMatrix), the
+// table is k x n, a row per input dim, so a nonzero of the input adds a
+// contiguous row of the table to the output, the cost is nonzeros x n
+// instead of k x n. The combiner SUM is a fully connect, MEAN and SQRTN
+// make it an embedding bag. A dense input runs the same as a gemm.
+class SparseFullyConnect: public Node {
+public:
+    typedef SparseFullyConnectParameter_Combiner Combiner;
+    SparseFullyConnect(): Node(NodeProto::SPARSE_FULLY_CONNECT), 
+        combiner_(SparseFullyConnectParameter::SUM), has_bias_(false),
+        activation_(ACTIVATION_NONE) {}
+    Node * Copy() const { return new SparseFullyConnect(*this); }
+    void FromProtoFunc(const NodeProto &proto);
+    void ToProtoFunc(NodeProto *proto) const; 
+    void SetTable(Matrix<float> table) { 
+        table_.reset(new Matrix<float>(std::move(table)));
+    }
+    void SetBias(const std::shared_ptr<const Vector<float> > &bias) { 
+        bias_ = bias; 
+        has_bias_ = bias != nullptr;
+    }
+    void SetCombiner(Combiner combiner) { combiner_ = combiner; }
+    bool FuseActivation(ActivationType act);
+    ActivationType FusedActivation() const { return activation_; }
+    void Forward(const Matrix<float> &in, Matrix<float> *out);
+    void Forward(const SparseMatrix &in, Matrix<float> *out);
+    int64_t Flops(const Matrix<float> &in) const {
+        return 2LL * in.NumRows() * table_->NumRows() * table_->NumCols();
+    }
+    int64_t Flops(const SparseMatrix &in) const {
+        return 2LL * in.NumNonZeros() * table_->NumCols();
+    }
+    int OutputDim(int input_dim) const { return table_->NumCols(); }
+    int InputDim() const { return table_->NumRows(); }
+    int64_t WeightBytes() const {
+        return sizeof(float) * (table_->Size() + (has_bias_ ? bias_->Size() : 0));
+    }
+private:
+    // 1 / sum(value), 1 / sqrt(sum(value^2)) or 1 of values
+    float CombinerScale(const float *value, int n) const;
+    // Read only, shared by the copies of the node
+    std::shared_ptr<const Matrix<float> > table_;
+    Combiner combiner_;
+    std::shared_ptr<const Vector<float> > bias_;
+    bool has_bias_;
+    ActivationType activation_;
 };
 
 
@@ -109,25 +567,116 @@ private:
 
 class XNet {
 public:
-    XNet() {}
-    XNet(std::string proto_file) {
+    XNet(): profiler_(nullptr), cache_(nullptr), cache_tag_(0) {}
+    XNet(std::string proto_file): profiler_(nullptr), cache_(nullptr), 
+                                  cache_tag_(0) {
         FromProto(proto_file);
     }
     ~XNet() {
         ClearNodes();
     }
-    void FromProto(std::string proto_file);
+    // Copy the nodes to net, the weights are shared, not copied, the
+    // buffers are not, so the replicas can Forward on different threads
+    void Copy(XNet *net) const;
+    // Same as Copy on the nodes [begin, end), eg: a pipeline stage
+    void Slice(int begin, int end, XNet *net) const;
+    // Run the default graph passes(see pass.h) on the nodes unless
+    // optimize is false
+    void FromProto(std::string proto_file, bool optimize = true);
+    void FromProto(const NetProto &net_proto, bool optimize = true);
+    // Read a NetProto file, false if it is missing or can not be parsed
+    // (eg: truncated)
+    static bool ReadProto(const std::string &proto_file, NetProto *net_proto);
+    // Check the input dim of every node matches the output dim of the 
+    // one before it on input of input_dim, error gets the mismatch
+    bool CheckDims(int input_dim, std::string *error) const;
     void ToProto(std::string proto_file) const;
+    // The fused activations are written back as nodes after their nodes
+    void ToProto(NetProto *net_proto) const;
     void Info(); 
-    void Quantize(XNet *net) const;
+    // bits 8(uint8) or 16(int16)
+    void Quantize(XNet *net, int bits = 8) const;
+    // Only quantize node i when quantize_mask[i] is true, others are copied
+    void Quantize(const std::vector<bool> &quantize_mask, XNet *net, 
+                  int bits = 8) const;
+    // Binarize(or ternarize) the fully connect node i when mask[i] is 
+    // true, others are copied
+    void Binarize(const std::vector<bool> &mask, bool ternary, 
+                  int input_bits, XNet *net) const;
+    // Palettize the weight of every fully connect node to a k-means
+    // codebook of codebook_size entries, others are copied. mse gets the
+    // mean squared error of every node(0 for the copied ones) if not
+    // nullptr.
+    void Palettize(int codebook_size, int num_iters, XNet *net, 
+                   std::vector<float> *mse = nullptr) const;
     void ClearNodes();
     void AddNode(Node *node) {
         nodes_.push_back(node); 
     }
+    // Fuse activation nodes into the nodes before them, FromProto does it,
+    // ToProto writes the fused activations back as separate nodes
+    void FuseActivations();
+    // Run the passes on the nodes then fuse the activations, return the 
+    // number of rewrites
+    int Optimize(const PassManager &passes);
+    int NumNodes() const { return nodes_.size(); }
+    const Node *GetNode(int i) const { 
+        CHECK(i >= 0 && i < nodes_.size());
+        return nodes_[i]; 
+    }
     void Forward(const Matrix<float> &in, Matrix<float> *out); 
+    // Forward a sparse input, the first node must be a SparseFullyConnect
+    void Forward(const SparseMatrix &in, Matrix<float> *out); 
+    // Forward on caller owned buffers without copy, in is rows x cols with
+    // in_stride floats from row to row, out is rows x OutputDim(cols) with 
+    // out_stride floats from row to row
+    void Forward(const float *in, int rows, int cols, int in_stride, 
+                 float *out, int out_stride);
+    int OutputDim(int input_dim) const;
+    // Set the output head of the last node, it must be a Softmax or
+    // (quantize) fully connect without fused activation
+    void SetOutputHead(const OutputHead &head);
+    // Profile every node in Forward, nullptr(default) to turn it off.
+    // The profiler is not owned by the net.
+    void SetProfiler(Profiler *profiler) { profiler_ = profiler; }
+    // Answer the rows of Forward(dense input) found in the cache from it,
+    // forward the others only and add them, nullptr(default) to turn it 
+    // off. The cache is not owned by the net, nor copied by Copy, the 
+    // replicas of a net can share one. The entries of the net are tagged
+    // with tag, see ResultCache. A batch dependent net(eg: a quantize fully
+    // connect) can not use a cache, a hit would be the output of the batch
+    // the row was first seen in, it is an error.
+    void SetResultCache(ResultCache *cache, uint64_t tag = 0);
+    // True if a node is batch dependent, see Node::BatchDependent
+    bool BatchDependent() const;
+    // Benchmark the kernels of every node for every batch bucket up to
+    // max_batch on random input of input_dim, and use the fastest ones
+    void Tune(int input_dim, int max_batch, TuneTable *table);
+    // Use the kernels of a tune table, eg: one written by xnet-tune. The 
+    // blas threads are process wide, so the nodes do not set theirs per
+    // forward, the max tuned one is set here once if set_blas_threads
+    void SetTuneTable(const TuneTable &table, bool set_blas_threads = true);
+    // Identify the net structure, a tune table only fits the same signature
+    std::string Signature() const;
 private:
+    void ForwardNode(int i, const Matrix<float> &in, Matrix<float> *out);
+    // Use the tuned kernels of the batch, and make the buffers
+    void PrepareForward(int batch);
+    // Forward nodes from begin to the last one, in is the input of node
+    // begin
+    void ForwardNodes(int begin, const Matrix<float> &in, Matrix<float> *out);
+    void ForwardCached(const Matrix<float> &in, Matrix<float> *out);
     std::vector<Node *> nodes_;
     std::vector<Matrix<float> *> forward_buf_;
+    Profiler *profiler_;
+    ResultCache *cache_;
+    uint64_t cache_tag_;
+    // Rows of the input not in the cache, and their input and output
+    std::vector<int> miss_rows_;
+    Matrix<float> miss_in_, miss_out_;
+    std::vector<std::vector<KernelConfig> > tuned_kernels_; // [bucket][node]
+    // The nodes are owned, use Copy() for replicas
+    DISALLOW_COPY_AND_ASSIGN(XNet);
 };
 
 #endif